@@ -0,0 +1,230 @@
+#ifndef ALLOCATOR_VARIANT_H
+#define ALLOCATOR_VARIANT_H
+
+#include "variant.h"
+#include <memory>
+#include <memory_resource>
+
+namespace vr {
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// allocator_variant<Alloc, Ts...> - variant<Ts...>, который помнит аллокатор и передает его альтернативам
+/// через uses-allocator construction (T(allocator_arg, a, args...) или T(args..., a), если T его принимает).
+/// Аллокатор задается при конструировании и дальше не меняется: emplace, присваивание с другой
+/// альтернативой и копирование строят новое значение с тем же аллокатором (как у std::pmr контейнеров,
+/// аллокатор не переезжает при присваивании). swap требует равных аллокаторов.
+///
+/// pmr::variant<Ts...> - то же с std::pmr::polymorphic_allocator:
+///
+///     std::pmr::monotonic_buffer_resource arena;
+///     vr::pmr::variant<int, std::pmr::string> v(std::allocator_arg, &arena, std::pmr::string("..."));
+///     v = std::pmr::string("..."); // строка в arena, а не в глобальной куче
+///
+/// Это наследник variant<Ts...>, поэтому get, get_if, holds_alternative, visit и сравнения работают без изменений.
+/// Методы базы, вызванные через ссылку на variant<Ts...>, аллокатор не видят.
+///
+
+namespace details {
+
+    namespace uses_allocator {
+
+        template<typename T, typename Alloc, typename... As>
+        inline constexpr bool leading_v = std::uses_allocator_v<T, Alloc> &&
+                                          std::is_constructible_v<T, std::allocator_arg_t, Alloc const&, As...>;
+
+        template<typename T, typename Alloc, typename... As>
+        inline constexpr bool trailing_v = std::uses_allocator_v<T, Alloc> && !leading_v<T, Alloc, As...> &&
+                                           std::is_constructible_v<T, As..., Alloc const&>;
+
+    } // end uses_allocator
+
+} // details end
+
+template<typename Alloc, typename... Ts>
+struct allocator_variant : variant<Ts...> {
+
+    using allocator_type = Alloc;
+
+//////////////////////////// Constructors ///////////////////////////////////
+
+    allocator_variant() : allocator_variant(std::allocator_arg, Alloc()) {}
+
+    allocator_variant(std::allocator_arg_t, Alloc const& a)
+        : variant<Ts...>(typename variant<Ts...>::valueless_tag()), alloc(a)
+    {
+        construct<0>();
+    }
+
+    template <typename T,
+              typename D = std::decay_t<T>,
+              std::enable_if_t<!std::is_same_v<D, allocator_variant> && !std::is_same_v<D, std::allocator_arg_t> &&
+                               !details::is_in_place_index_v<D> && !details::is_in_place_type_v<D>>* = nullptr,
+              std::size_t I = details::find_best_match_v<T, Ts...>>
+    allocator_variant(T&& arg) : allocator_variant(std::allocator_arg, Alloc(), std::forward<T>(arg)) {}
+
+    template <typename T,
+              typename D = std::decay_t<T>,
+              std::enable_if_t<!std::is_same_v<D, allocator_variant> &&
+                               !details::is_in_place_index_v<D> && !details::is_in_place_type_v<D>>* = nullptr,
+              std::size_t I = details::find_best_match_v<T, Ts...>>
+    allocator_variant(std::allocator_arg_t, Alloc const& a, T&& arg)
+        : variant<Ts...>(typename variant<Ts...>::valueless_tag()), alloc(a)
+    {
+        construct<I>(std::forward<T>(arg));
+    }
+
+    template <std::size_t I, typename... As>
+    explicit allocator_variant(std::in_place_index_t<I>, As&&... args)
+        : allocator_variant(std::allocator_arg, Alloc(), std::in_place_index<I>, std::forward<As>(args)...) {}
+
+    template <typename T, typename... As, std::size_t I = details::alternative_index_v<T, Ts...>>
+    explicit allocator_variant(std::in_place_type_t<T>, As&&... args)
+        : allocator_variant(std::allocator_arg, Alloc(), std::in_place_index<I>, std::forward<As>(args)...) {}
+
+    template <std::size_t I, typename... As>
+    allocator_variant(std::allocator_arg_t, Alloc const& a, std::in_place_index_t<I>, As&&... args)
+        : variant<Ts...>(typename variant<Ts...>::valueless_tag()), alloc(a)
+    {
+        construct<I>(std::forward<As>(args)...);
+    }
+
+    template <typename T, typename... As, std::size_t I = details::alternative_index_v<T, Ts...>>
+    allocator_variant(std::allocator_arg_t, Alloc const& a, std::in_place_type_t<T>, As&&... args)
+        : allocator_variant(std::allocator_arg, a, std::in_place_index<I>, std::forward<As>(args)...) {}
+
+    allocator_variant(allocator_variant const& other)
+        : allocator_variant(std::allocator_arg, std::allocator_traits<Alloc>::select_on_container_copy_construction(other.alloc), other) {}
+
+    allocator_variant(std::allocator_arg_t, Alloc const& a, allocator_variant const& other)
+        : variant<Ts...>(typename variant<Ts...>::valueless_tag()), alloc(a)
+    {
+        if (!other.valueless_by_exception()) {
+            details::visitor::dispatch_index<sizeof...(Ts)>(other.index(), [&](auto I) {
+                construct<decltype(I)::value>(alternative<decltype(I)::value>(other));
+            });
+        }
+    }
+
+    /// Перемещение забирает и значение, и аллокатор, под которым оно построено
+    allocator_variant(allocator_variant&& other) noexcept((std::is_nothrow_move_constructible_v<Ts> && ...))
+        : variant<Ts...>(static_cast<variant<Ts...>&&>(other)), alloc(other.alloc) {}
+
+//////////////////////////// Assignment ///////////////////////////////////
+
+    allocator_variant& operator =(allocator_variant const& rhs) {
+        if (this != &rhs) assign_from(rhs);
+        return *this;
+    }
+
+    allocator_variant& operator =(allocator_variant&& rhs) {
+        if (this != &rhs) assign_from(std::move(rhs));
+        return *this;
+    }
+
+    template <typename A,
+              std::enable_if_t<!std::is_same_v<std::decay_t<A>, allocator_variant>>* = nullptr,
+              std::size_t I = details::find_best_match_v<A, Ts...>,
+              typename T = details::get_type_at_t<I, Ts...>,
+              std::enable_if_t<std::is_assignable_v<T&, A>>* = nullptr>
+    allocator_variant& operator =(A&& arg) {
+        if (this->index() == I) {
+            details::access::storage_base_helper::get_alternative<I>(this->storage).value = std::forward<A>(arg);
+        } else {
+            emplace<I>(std::forward<A>(arg));
+        }
+        return *this;
+    }
+
+//////////////////////////// Modifiers ///////////////////////////////////
+
+    template <std::size_t I, typename... As>
+    decltype(auto) emplace(As&&... args) {
+        this->storage.destroy();
+        return details::unbox(construct<I>(std::forward<As>(args)...));
+    }
+
+    template <typename T, typename... As, std::size_t I = details::alternative_index_v<T, Ts...>>
+    T& emplace(As&&... args) {
+        return emplace<I>(std::forward<As>(args)...);
+    }
+
+    /// Аллокаторы должны быть равны: значения меняются местами вместе с памятью, в которой лежат
+    void swap(allocator_variant& rhs) noexcept(noexcept(std::declval<variant<Ts...>&>().swap(std::declval<variant<Ts...>&>()))) {
+        assert(alloc == rhs.alloc && "allocator_variant::swap requires equal allocators");
+        variant<Ts...>::swap(rhs);
+    }
+
+    allocator_type get_allocator() const noexcept {
+        return alloc;
+    }
+
+private:
+
+    template<std::size_t I, typename V>
+    static decltype(auto) alternative(V&& v) {
+        return (details::access::storage_base_helper::get_alternative<I>(std::forward<V>(v).storage).value);
+    }
+
+    /// Строит альтернативу I в пустом хранилище, добавляя аллокатор к аргументам, если альтернатива его принимает;
+    /// при исключении variant остается valueless_by_exception
+    template<std::size_t I, typename... As>
+    details::get_type_at_t<I, Ts...>& construct(As&&... args) {
+        using T = details::get_type_at_t<I, Ts...>;
+        auto& place = details::access::storage_base_helper::get_alternative<I>(this->storage);
+        auto& value = [&]() -> T& {
+            if constexpr (details::uses_allocator::leading_v<T, Alloc, As...>) {
+                return this->storage.construct_alternative(place, std::allocator_arg, alloc, std::forward<As>(args)...);
+            } else if constexpr (details::uses_allocator::trailing_v<T, Alloc, As...>) {
+                return this->storage.construct_alternative(place, std::forward<As>(args)..., alloc);
+            } else {
+                static_assert(!std::uses_allocator_v<T, Alloc>, "alternative uses the allocator but can not be constructed with it");
+                return this->storage.construct_alternative(place, std::forward<As>(args)...);
+            }
+        }();
+        this->storage.indx = I;
+        return value;
+    }
+
+    template<typename V>
+    void assign_from(V&& rhs) {
+        if (rhs.valueless_by_exception()) {
+            this->storage.destroy();
+            return;
+        }
+        details::visitor::dispatch_index<sizeof...(Ts)>(rhs.index(), [&](auto I) {
+            constexpr std::size_t i = decltype(I)::value;
+            if (this->index() == i) {
+                alternative<i>(*this) = alternative<i>(std::forward<V>(rhs));
+            } else {
+                emplace<i>(alternative<i>(std::forward<V>(rhs)));
+            }
+        });
+    }
+
+    VR_NO_UNIQUE_ADDRESS Alloc alloc;
+};
+
+template<typename Alloc, typename... Ts>
+struct variant_size<allocator_variant<Alloc, Ts...>> : std::integral_constant<std::size_t, sizeof...(Ts)> {};
+
+template<std::size_t I, typename Alloc, typename... Ts>
+struct variant_alternative<I, allocator_variant<Alloc, Ts...>> {
+    using type = details::get_type_at_t<I, Ts...>;
+};
+
+template <class Alloc, class... Types>
+void swap(allocator_variant<Alloc, Types...>& lhs, allocator_variant<Alloc, Types...>& rhs) noexcept(noexcept(lhs.swap(rhs))) {
+    lhs.swap(rhs);
+}
+
+namespace pmr {
+
+    template<typename... Ts>
+    using variant = allocator_variant<std::pmr::polymorphic_allocator<std::byte>, Ts...>;
+
+} // end pmr
+
+} // end vr
+
+#endif // ALLOCATOR_VARIANT_H
@@ -0,0 +1,582 @@
+#include <bits/stdc++.h>
+#include "variant.h"
+#include "nanbox_variant.h"
+#include "strict_variant.h"
+#include "allocator_variant.h"
+#include "tag_scan.h"
+#include "flatten.h"
+
+/// Замеры производительности. Запуск: ./Variant_benchmark [подстрока имени замера]
+/// Цифры имеют смысл только в сборке с оптимизациями и без санитайзеров.
+
+namespace bench {
+
+    using clock = std::chrono::steady_clock;
+
+    inline std::string filter;
+
+    inline bool selected(std::string const& name) {
+        return name.find(filter) != std::string::npos;
+    }
+
+    /// Нужно ли готовить данные группы замеров с именами "prefix...": фильтр - часть префикса или начинается с него
+    inline bool group_selected(std::string const& prefix) {
+        return selected(prefix) || filter.rfind(prefix, 0) == 0;
+    }
+
+    template<typename F>
+    void run(std::string const& name, F&& f) {
+        if (!selected(name)) return;
+        auto start = clock::now();
+        auto result = f();
+        double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+        std::cout << std::left << std::setw(56) << name << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(10) << ms << " ms   (" << result << ")" << std::endl;
+    }
+
+    /// Счетчик вызовов глобального operator new (замена ниже)
+    inline std::size_t global_allocations = 0;
+
+} // end bench
+
+void* operator new(std::size_t size) {
+    ++bench::global_allocations;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void* operator new(std::size_t size, std::align_val_t align) {
+    ++bench::global_allocations;
+    if (void* p = std::aligned_alloc(std::size_t(align), (size + std::size_t(align) - 1) / std::size_t(align) * std::size_t(align))) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+/////////////////////////////////////////////////////// nanbox_variant ///////////////////////////////////////////////////
+
+namespace nanbox_bench {
+
+    struct object { int id; };
+
+    using boxed = vr::nanbox_variant<double, int32_t, bool, vr::monostate, object*>;
+    using plain = vr::variant<double, int32_t, bool, vr::monostate, object*>;
+
+    constexpr std::size_t count = 1 << 20;
+    constexpr int passes = 20;
+
+    /// Смесь, типичная для интерпретатора: в основном double и int, немного bool
+    template<typename V>
+    std::vector<V> make_values() {
+        std::mt19937 gen(42);
+        std::uniform_int_distribution<int> kind(0, 99);
+        std::vector<V> values;
+        values.reserve(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            int k = kind(gen);
+            if (k < 70) values.emplace_back(double(i) * 0.5);
+            else if (k < 95) values.emplace_back(int32_t(i));
+            else values.emplace_back(k % 2 == 0);
+        }
+        return values;
+    }
+
+    struct to_number {
+        double operator()(double a) const { return a; }
+        double operator()(int32_t a) const { return a; }
+        double operator()(bool a) const { return a; }
+        double operator()(vr::monostate) const { return 0; }
+        double operator()(object*) const { return 0; }
+    };
+
+    /// a[i] = a[i] * 0.5 + 1, int остается int: чтение, арифметика и запись обратно в variant
+    template<typename V>
+    double arithmetic(std::vector<V>& values) {
+        double sum = 0;
+        for (int pass = 0; pass < passes; ++pass) {
+            for (V& v : values) {
+                if (v.index() == 1) {
+                    v = int32_t(vr::get<int32_t>(v) / 2 + 1);
+                } else {
+                    double x = vr::visit(to_number(), v);
+                    v = x * 0.5 + 1;
+                    sum += x;
+                }
+            }
+        }
+        return sum;
+    }
+
+    void run() {
+        std::cout << "sizeof(variant) = " << sizeof(plain) << ", sizeof(nanbox_variant) = " << sizeof(boxed) << std::endl;
+        auto plain_values = make_values<plain>();
+        auto boxed_values = make_values<boxed>();
+        bench::run("nanbox: arithmetic loop, variant (storage_t)", [&] { return arithmetic(plain_values); });
+        bench::run("nanbox: arithmetic loop, nanbox_variant", [&] { return arithmetic(boxed_values); });
+    }
+
+} // end nanbox_bench
+
+/////////////////////////////////////////////////////// visit dispatch ///////////////////////////////////////////////////
+
+namespace dispatch_bench {
+
+    template<std::size_t I>
+    struct alt { int value; };
+
+    template<typename Is>
+    struct make_variant;
+
+    template<std::size_t... Is>
+    struct make_variant<std::index_sequence<Is...>> {
+        using type = vr::variant<alt<Is>...>;
+    };
+
+    template<std::size_t N>
+    using variant_of = typename make_variant<std::make_index_sequence<N>>::type;
+
+    constexpr std::size_t count = 1 << 20;
+    constexpr int passes = 20;
+
+    struct weigh {
+        template<std::size_t I>
+        long operator()(alt<I> const& a) const { return a.value * long(I + 1); }
+    };
+
+    template<std::size_t N>
+    std::vector<variant_of<N>> make_values() {
+        std::mt19937 gen(7);
+        std::vector<variant_of<N>> values;
+        values.reserve(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            std::size_t index = gen() % N;
+            values.push_back(vr::details::visitor::dispatch_index<N>(index, [i](auto I) {
+                return variant_of<N>(std::in_place_index<decltype(I)::value>, alt<decltype(I)::value>{int(i % 100)});
+            }));
+        }
+        return values;
+    }
+
+    template<vr::visit_strategy S, typename V>
+    long sum(std::vector<V> const& values) {
+        long total = 0;
+        for (int pass = 0; pass < passes; ++pass)
+            for (V const& v : values)
+                total += vr::visit_with<S>(weigh(), v);
+        return total;
+    }
+
+    template<std::size_t N>
+    void run_for() {
+        auto values = make_values<N>();
+        std::string suffix = std::to_string(N) + " alternatives";
+        bench::run("dispatch: table, " + suffix, [&] { return sum<vr::visit_strategy::table>(values); });
+        bench::run("dispatch: inline_switch, " + suffix, [&] { return sum<vr::visit_strategy::inline_switch>(values); });
+    }
+
+    void run() {
+        run_for<2>();
+        run_for<3>();
+        run_for<8>();
+        run_for<24>();
+    }
+
+} // end dispatch_bench
+
+/////////////////////////////////////////////////////// visit_likely ///////////////////////////////////////////////////
+
+namespace likely_bench {
+
+    using dispatch_bench::alt;
+    using value = dispatch_bench::variant_of<8>;
+
+    constexpr std::size_t count = 1 << 20;
+    constexpr int passes = 20;
+
+    /// hot_percent% значений - alt<0>, остальные равномерно по всем 8 альтернативам
+    std::vector<value> make_values(int hot_percent) {
+        std::mt19937 gen(11);
+        std::uniform_int_distribution<int> percent(0, 99);
+        std::vector<value> values;
+        values.reserve(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            std::size_t index = percent(gen) < hot_percent ? 0 : gen() % 8;
+            values.push_back(vr::details::visitor::dispatch_index<8>(index, [i](auto I) {
+                return value(std::in_place_index<decltype(I)::value>, alt<decltype(I)::value>{int(i % 100)});
+            }));
+        }
+        return values;
+    }
+
+    template<typename F>
+    long sum(std::vector<value> const& values, F&& visit_one) {
+        long total = 0;
+        for (int pass = 0; pass < passes; ++pass)
+            for (value const& v : values)
+                total += visit_one(v);
+        return total;
+    }
+
+    void run() {
+        for (int hot_percent : {0, 50, 90, 95, 99}) {
+            auto values = make_values(hot_percent);
+            std::string suffix = std::to_string(hot_percent) + "% alt<0>";
+            bench::run("likely: visit, " + suffix, [&] {
+                return sum(values, [](value const& v) { return vr::visit(dispatch_bench::weigh(), v); });
+            });
+            bench::run("likely: visit_likely<alt<0>>, " + suffix, [&] {
+                return sum(values, [](value const& v) { return vr::visit_likely<alt<0>>(dispatch_bench::weigh(), v); });
+            });
+        }
+    }
+
+} // end likely_bench
+
+/////////////////////////////////////////////////////// strict_variant ///////////////////////////////////////////////////
+
+namespace strict_bench {
+
+    constexpr std::size_t count = 1 << 20;
+    constexpr int passes = 20;
+
+    template<typename V>
+    std::vector<V> make_values() {
+        std::mt19937 gen(5);
+        std::vector<V> values;
+        values.reserve(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            if (gen() % 2) values.emplace_back(int(i % 1000));
+            else values.emplace_back(double(i % 1000) * 0.25);
+        }
+        return values;
+    }
+
+    struct to_number {
+        double operator()(int a) const { return a; }
+        double operator()(double a) const { return a; }
+        double operator()(std::string const& s) const { return double(s.size()); }
+    };
+
+    /// Чтение через visit и get, запись с переключением альтернативы
+    template<typename V>
+    double churn(std::vector<V>& values) {
+        double sum = 0;
+        for (int pass = 0; pass < passes; ++pass) {
+            for (V& v : values) {
+                sum += vr::visit(to_number(), v);
+                if (v.index() == 0) {
+                    v = double(vr::get<0>(v)) * 0.5;
+                } else {
+                    v = int(vr::get<1>(v)) + 1;
+                }
+            }
+        }
+        return sum;
+    }
+
+    void run() {
+        using plain = vr::variant<int, double, std::string>;
+        using strict = vr::strict_variant<int, double, std::string>;
+        auto plain_values = make_values<plain>();
+        auto strict_values = make_values<strict>();
+        bench::run("strict: visit, get, reassign; variant", [&] { return churn(plain_values); });
+        bench::run("strict: visit, get, reassign; strict_variant", [&] { return churn(strict_values); });
+    }
+
+} // end strict_bench
+
+/////////////////////////////////////////////////////// allocator_variant ///////////////////////////////////////////////////
+
+namespace pmr_bench {
+
+    constexpr std::size_t count = 1 << 16;
+    constexpr int passes = 20;
+
+    /// Обработка "запроса": вектор значений, половина - строки длиннее SSO, потом каждое второе значение
+    /// меняет альтернативу на строку. Строки строятся на месте (emplace), без временных std::pmr::string
+    template<typename V, typename Make>
+    std::size_t handle_request(Make&& make) {
+        std::vector<V> values;
+        values.reserve(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            if (i % 2) values.push_back(make(std::in_place_index<1>, std::size_t(40), char('a' + i % 26)));
+            else values.push_back(make(std::in_place_index<0>, int(i)));
+        }
+        std::size_t total = 0;
+        for (std::size_t i = 0; i < count; i += 2) {
+            values[i].template emplace<std::pmr::string>(std::size_t(48), 'z');
+            total += vr::get<std::pmr::string>(values[i]).size();
+        }
+        return total;
+    }
+
+    template<typename F>
+    std::string allocations(F&& f) {
+        std::size_t before = bench::global_allocations;
+        std::size_t result = 0;
+        for (int pass = 0; pass < passes; ++pass) result += f();
+        return std::to_string(bench::global_allocations - before) + " global allocations, " + std::to_string(result);
+    }
+
+    void run() {
+        using plain = vr::variant<int, std::pmr::string>;
+        using pooled = vr::pmr::variant<int, std::pmr::string>;
+        bench::run("pmr: request, variant", [] {
+            return allocations([] {
+                return handle_request<plain>([](auto... args) { return plain(args...); });
+            });
+        });
+        bench::run("pmr: request, pmr::variant + monotonic arena", [] {
+            return allocations([] {
+                std::pmr::monotonic_buffer_resource arena(count * 128);
+                std::pmr::polymorphic_allocator<std::byte> alloc(&arena);
+                return handle_request<pooled>([&](auto... args) { return pooled(std::allocator_arg, alloc, args...); });
+            });
+        });
+    }
+
+} // end pmr_bench
+
+/////////////////////////////////////////////////////// comparison ///////////////////////////////////////////////////
+
+namespace compare_bench {
+
+    constexpr std::size_t count = 10'000'000;
+
+    /// В основном числа с повторами, каждое десятое значение - короткая строка (в SSO)
+    template<typename V>
+    std::vector<V> make_values() {
+        std::mt19937 gen(11);
+        std::vector<V> values;
+        values.reserve(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            auto r = gen();
+            if (r % 10 == 0) values.emplace_back(std::in_place_index<2>, "k" + std::to_string(r % 50000));
+            else if (r % 2) values.emplace_back(std::in_place_index<0>, int(r % 1000000));
+            else values.emplace_back(std::in_place_index<1>, double(r % 1000000) * 0.5);
+        }
+        return values;
+    }
+
+    template<typename V>
+    std::size_t sort_unique(std::vector<V>& values) {
+        std::sort(values.begin(), values.end());
+        values.erase(std::unique(values.begin(), values.end()), values.end());
+        return values.size();
+    }
+
+    /// Значения строятся только для выбранных замеров: 10M вариантов - это сотни мегабайт
+    template<typename V>
+    void run_one(std::string const& name) {
+        if (!bench::selected(name)) return;
+        auto values = make_values<V>();
+        bench::run(name, [&] { return sort_unique(values); });
+    }
+
+    void run() {
+        run_one<std::variant<int, double, std::string>>("compare: sort + unique 10M, std::variant");
+        run_one<vr::variant<int, double, std::string>>("compare: sort + unique 10M, variant");
+    }
+
+} // end compare_bench
+
+/////////////////////////////////////////////////////// bulk visitation ///////////////////////////////////////////////////
+
+namespace visit_each_bench {
+
+    using dispatch_bench::alt;
+    using value = dispatch_bench::variant_of<8>;
+
+    constexpr std::size_t count = 1 << 22;
+    constexpr int passes = 10;
+
+    /// Альтернативы равновероятны среди первых 2^bits: энтропия тега - bits бит на элемент
+    std::vector<value> make_values(unsigned bits) {
+        std::mt19937 gen(5);
+        std::vector<value> values;
+        values.reserve(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            std::size_t index = gen() % (1u << bits);
+            values.push_back(vr::details::visitor::dispatch_index<8>(index, [i](auto I) {
+                return value(std::in_place_index<decltype(I)::value>, alt<decltype(I)::value>{int(i % 100)});
+            }));
+        }
+        return values;
+    }
+
+    template<typename F>
+    long sum(F&& each) {
+        long total = 0;
+        auto add = [&total](auto const& a) { total += dispatch_bench::weigh()(a); };
+        for (int pass = 0; pass < passes; ++pass) each(add);
+        return total;
+    }
+
+    void run_for(unsigned bits) {
+        std::string suffix = ", " + std::to_string(bits) + " bit tags";
+        if (!bench::group_selected("visit_each: ")) return;
+        auto values = make_values(bits);
+        bench::run("visit_each: visit loop" + suffix, [&] {
+            return sum([&](auto& add) { for (value const& v : values) vr::visit(add, v); });
+        });
+        bench::run("visit_each: visit_each" + suffix, [&] {
+            return sum([&](auto& add) { vr::visit_each(values, add); });
+        });
+        bench::run("visit_each: visit_each_ordered" + suffix, [&] {
+            return sum([&](auto& add) { vr::visit_each_ordered(values, add); });
+        });
+    }
+
+    void run() {
+        for (unsigned bits : {0u, 1u, 2u, 3u}) run_for(bits);
+    }
+
+} // end visit_each_bench
+
+/////////////////////////////////////////////////////// tag scanning ///////////////////////////////////////////////////
+
+namespace tag_scan_bench {
+
+    using value = vr::variant<int, double, float, long>;
+
+    constexpr std::size_t count = 1 << 24;
+    constexpr int passes = 20;
+
+    std::vector<value> make_values() {
+        std::mt19937 gen(3);
+        std::vector<value> values;
+        values.reserve(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            switch (gen() % 4) {
+            case 0: values.emplace_back(int(i)); break;
+            case 1: values.emplace_back(double(i)); break;
+            case 2: values.emplace_back(float(i)); break;
+            default: values.emplace_back(long(i)); break;
+            }
+        }
+        return values;
+    }
+
+    template<typename F>
+    std::size_t repeat(F&& f) {
+        std::size_t total = 0;
+        for (int pass = 0; pass < passes; ++pass) total += f();
+        return total;
+    }
+
+    void run() {
+        if (!bench::group_selected("tag_scan: ")) return;
+        auto values = make_values();
+        vr::variant_vector<int, double, float, long> columns;
+        for (value const& v : values) columns.push_back(v);
+
+        bench::run("tag_scan: count, holds_alternative loop", [&] {
+            return repeat([&] {
+                std::size_t n = 0;
+                for (value const& v : values) n += vr::holds_alternative<double>(v);
+                return n;
+            });
+        });
+        for (vr::simd_level level : {vr::simd_level::scalar, vr::simd_level::sse2, vr::simd_level::avx2}) {
+            vr::limit_tag_scan(level);
+            std::string suffix = ", level " + std::to_string(int(vr::tag_scan_level()));
+            bench::run("tag_scan: count_alternative, variant array" + suffix, [&] {
+                return repeat([&] { return vr::count_alternative<double>(values.data(), values.size()); });
+            });
+            bench::run("tag_scan: find_tag, packed tags" + suffix, [&] {
+                return repeat([&] { return vr::find_tag(columns.tags().data(), columns.size(), 1).size(); });
+            });
+            bench::run("tag_scan: count_tag, packed tags" + suffix, [&] {
+                return repeat([&] { return vr::count_tag(columns.tags().data(), columns.size(), 1); });
+            });
+            bench::run("tag_scan: alternative_histogram, variant array" + suffix, [&] {
+                return repeat([&] { return vr::alternative_histogram(values.data(), values.size())[2]; });
+            });
+            bench::run("tag_scan: alternative_histogram, packed tags" + suffix, [&] {
+                return repeat([&] { return vr::alternative_histogram(columns)[2]; });
+            });
+        }
+        vr::limit_tag_scan(vr::simd_level::avx2);
+    }
+
+} // end tag_scan_bench
+
+namespace flatten_bench {
+
+    using message = vr::variant<int, vr::variant<double, float>, vr::variant<char, vr::variant<long, unsigned>>>;
+
+    constexpr std::size_t count = 1 << 22;
+    constexpr int passes = 10;
+
+    /// Листья равновероятны: половина значений лежит на третьем уровне
+    std::vector<message> make_values() {
+        std::mt19937 gen(9);
+        std::vector<message> values;
+        values.reserve(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            int x = int(i % 100);
+            switch (gen() % 6) {
+            case 0: values.emplace_back(x); break;
+            case 1: values.emplace_back(vr::variant<double, float>(double(x))); break;
+            case 2: values.emplace_back(vr::variant<double, float>(float(x))); break;
+            case 3: values.emplace_back(vr::variant<char, vr::variant<long, unsigned>>(char(x))); break;
+            case 4: values.emplace_back(vr::variant<char, vr::variant<long, unsigned>>(vr::variant<long, unsigned>(long(x)))); break;
+            default: values.emplace_back(vr::variant<char, vr::variant<long, unsigned>>(vr::variant<long, unsigned>(unsigned(x)))); break;
+            }
+        }
+        return values;
+    }
+
+    struct weigh {
+        template<typename T>
+        long operator()(T const& x) const {
+            if constexpr (vr::details::flatten::is_variant_v<T>) return vr::visit(*this, x);
+            else return long(x);
+        }
+    };
+
+    template<typename F>
+    long sum(std::vector<message> const& values, F&& f) {
+        long total = 0;
+        for (int pass = 0; pass < passes; ++pass) {
+            for (message const& m : values) total += f(m);
+        }
+        return total;
+    }
+
+    void run() {
+        if (!bench::group_selected("flatten: ")) return;
+        auto values = make_values();
+        bench::run("flatten: nested visit", [&] { return sum(values, [](message const& m) { return vr::visit(weigh(), m); }); });
+        bench::run("flatten: visit_flat", [&] { return sum(values, [](message const& m) { return vr::visit_flat(weigh(), m); }); });
+    }
+
+} // end flatten_bench
+
+int main(int argc, char* argv[]) {
+    if (argc > 1) bench::filter = argv[1];
+    nanbox_bench::run();
+    dispatch_bench::run();
+    likely_bench::run();
+    strict_bench::run();
+    pmr_bench::run();
+    compare_bench::run();
+    visit_each_bench::run();
+    tag_scan_bench::run();
+    flatten_bench::run();
+    return 0;
+}
@@ -0,0 +1,279 @@
+#ifndef BOXED_H
+#define BOXED_H
+
+#include "variant.h"
+#include <mutex>
+
+namespace vr {
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// boxed<T> - альтернатива, которая хранит T в куче, а в самом variant занимает один указатель.
+/// variant<int, boxed<stype>> весит 16 байт вместо sizeof(stype) + 8, а visit, get, get_if, holds_alternative
+/// и emplace работают с ним как с variant<int, stype>: visitor получает stype&, get<stype>(v) - stype&.
+///
+/// boxing_variant<Threshold, Ts...> сам заворачивает в boxed альтернативы больше Threshold байт.
+///
+/// Память под T берется из пула узлов одного размера, а не из глобального new: свободные узлы лежат
+/// в односвязном списке, своем для каждого потока. Узел, освобожденный в другом потоке, попадает в список
+/// этого потока, но поток держит не больше local_limit свободных узлов: лишние порциями уходят в общий список,
+/// из которого берут узлы все потоки, прежде чем выделить новый кусок. При выходе потока его свободные узлы
+/// тоже возвращаются в общий список. Поэтому при схеме производитель/потребитель память не растет: свободных
+/// узлов не больше local_limit на поток плюс общий список. Куски по chunk_nodes узлов операционной системе
+/// не возвращаются - они живут до конца программы.
+///
+/// После перемещения boxed пуст (как std::unique_ptr). Поэтому variant, из которого переместили boxed
+/// альтернативу, становится valueless_by_exception (is_empty_after_move): visit, get и get_if не читают
+/// пустой boxed, а бросают bad_variant_access или возвращают nullptr.
+///
+
+namespace details {
+
+    namespace box_pool {
+
+        template<std::size_t Size, std::size_t Align>
+        struct pool {
+
+            union node {
+                node* next;
+                alignas(Align) unsigned char bytes[Size];
+            };
+
+            constexpr static std::size_t chunk_nodes = 64;
+
+            /// Больше стольких свободных узлов поток у себя не держит
+            constexpr static std::size_t local_limit = 2 * chunk_nodes;
+
+            /// Все выделенные куски и общий список свободных узлов
+            struct chunks {
+                std::mutex lock;
+                std::vector<node*> owned;
+                node* shared = nullptr;
+            };
+
+            /// Никогда не уничтожается: глобальные и статические варианты с boxed освобождают узлы
+            /// при разрушении статических объектов, в том числе после того, как разрушился бы сам реестр
+            static chunks& registry() {
+                static chunks* instance = new chunks;
+                return *instance;
+            }
+
+            /// Тривиальный thread_local: его можно трогать и пока уничтожаются другие объекты потока
+            struct local_list {
+                node* head;
+                std::size_t count;
+                bool armed;
+            };
+
+            static inline thread_local local_list local{nullptr, 0, false};
+
+            /// При выходе потока отдает его свободные узлы в общий список
+            struct releaser {
+                ~releaser() {
+                    give_back(local.head, local.count);
+                    local.head = nullptr;
+                    local.count = 0;
+                }
+            };
+
+            static void* allocate() {
+                node* n = local.head;
+                if (VR_LIKELY(n != nullptr)) {
+                    local.head = n->next;
+                    --local.count;
+                    return n;
+                }
+                return refill();
+            }
+
+            static void deallocate(void* p) noexcept {
+                node* n = static_cast<node*>(p);
+                n->next = local.head;
+                local.head = n;
+                if (VR_LIKELY(++local.count <= local_limit && local.armed)) return;
+                spill();
+            }
+
+            static void arm() noexcept {
+                static thread_local releaser on_exit;
+                (void)on_exit;
+                local.armed = true;
+            }
+
+            /// Первые count узлов списка first - в общий список
+            static void give_back(node* first, std::size_t count) noexcept {
+                if (count == 0) return;
+                node* last = first;
+                for (std::size_t i = 1; i < count; ++i) last = last->next;
+                chunks& r = registry();
+                std::lock_guard<std::mutex> guard(r.lock);
+                last->next = r.shared;
+                r.shared = first;
+            }
+
+            /// Лишние chunk_nodes узлов с головы списка потока - в общий список
+            static void spill() noexcept {
+                if (!local.armed) arm();
+                if (local.count <= local_limit) return;
+                node* batch = local.head;
+                node* last = batch;
+                for (std::size_t i = 1; i < chunk_nodes; ++i) last = last->next;
+                local.head = last->next;
+                local.count -= chunk_nodes;
+                last->next = nullptr;
+                give_back(batch, chunk_nodes);
+            }
+
+            /// Список потока пуст: до chunk_nodes узлов из общего списка, иначе новый кусок
+            static void* refill() {
+                if (!local.armed) arm();
+                chunks& r = registry();
+                std::lock_guard<std::mutex> guard(r.lock);
+                if (node* first = r.shared) {
+                    node* last = first;
+                    std::size_t count = 1;
+                    for (; count < chunk_nodes && last->next; ++count) last = last->next;
+                    r.shared = last->next;
+                    last->next = nullptr;
+                    local.head = first->next;
+                    local.count = count - 1;
+                    return first;
+                }
+                r.owned.push_back(nullptr);
+                node* chunk = static_cast<node*>(::operator new(sizeof(node) * chunk_nodes, std::align_val_t(alignof(node))));
+                r.owned.back() = chunk;
+                for (std::size_t i = 1; i + 1 < chunk_nodes; ++i) {
+                    chunk[i].next = &chunk[i + 1];
+                }
+                chunk[chunk_nodes - 1].next = nullptr;
+                local.head = &chunk[1];
+                local.count = chunk_nodes - 1;
+                return &chunk[0];
+            }
+        };
+
+        template<typename T>
+        using pool_for = pool<sizeof(T), alignof(T)>;
+
+    } // end box_pool
+
+} // details end
+
+template<typename T>
+class boxed {
+
+    using pool = details::box_pool::pool_for<T>;
+
+public:
+
+    using value_type = T;
+
+    boxed(T const& value) : ptr(make(value)) {}
+    boxed(T&& value) : ptr(make(std::move(value))) {}
+
+    /// boxed<T>(args...) == boxed<T>(T(args...)), без лишнего перемещения: так работают emplace и in_place_index
+    template<typename A, typename... As,
+             std::enable_if_t<!std::is_same_v<std::decay_t<A>, boxed> && !std::is_same_v<std::decay_t<A>, T> &&
+                              std::is_constructible_v<T, A, As...>>* = nullptr>
+    explicit boxed(A&& arg, As&&... args) : ptr(make(std::forward<A>(arg), std::forward<As>(args)...)) {}
+
+    template<typename U = T, std::enable_if_t<std::is_default_constructible_v<U>>* = nullptr>
+    boxed() : ptr(make()) {}
+
+    boxed(boxed const& other) : ptr(other.ptr ? make(*other.ptr) : nullptr) {}
+    boxed(boxed&& other) noexcept : ptr(std::exchange(other.ptr, nullptr)) {}
+
+    boxed& operator =(boxed const& other) {
+        if (ptr && other.ptr) {
+            *ptr = *other.ptr;
+        } else if (this != &other) {
+            boxed copy(other);
+            swap(copy);
+        }
+        return *this;
+    }
+
+    boxed& operator =(boxed&& other) noexcept {
+        if (this != &other) {
+            reset();
+            ptr = std::exchange(other.ptr, nullptr);
+        }
+        return *this;
+    }
+
+    boxed& operator =(T const& value) {
+        if (ptr) *ptr = value;
+        else ptr = make(value);
+        return *this;
+    }
+
+    boxed& operator =(T&& value) {
+        if (ptr) *ptr = std::move(value);
+        else ptr = make(std::move(value));
+        return *this;
+    }
+
+    ~boxed() {
+        reset();
+    }
+
+    T& operator *() & noexcept { return *ptr; }
+    T const& operator *() const& noexcept { return *ptr; }
+    T&& operator *() && noexcept { return std::move(*ptr); }
+    T const&& operator *() const&& noexcept { return std::move(*ptr); }
+
+    T* operator ->() noexcept { return ptr; }
+    T const* operator ->() const noexcept { return ptr; }
+
+    bool valueless_after_move() const noexcept {
+        return ptr == nullptr;
+    }
+
+    void swap(boxed& other) noexcept {
+        std::swap(ptr, other.ptr);
+    }
+
+    friend bool operator ==(boxed const& a, boxed const& b) { return *a == *b; }
+    friend bool operator !=(boxed const& a, boxed const& b) { return *a != *b; }
+    friend bool operator <(boxed const& a, boxed const& b) { return *a < *b; }
+
+private:
+
+    template<typename... As>
+    static T* make(As&&... args) {
+        void* place = pool::allocate();
+        VR_TRY {
+            return new (place) T(std::forward<As>(args)...);
+        } VR_CATCH_ALL {
+            pool::deallocate(place);
+            VR_RETHROW;
+        }
+    }
+
+    void reset() noexcept {
+        if (ptr) {
+            ptr->~T();
+            pool::deallocate(ptr);
+            ptr = nullptr;
+        }
+    }
+
+    T* ptr;
+};
+
+/// Внутри только указатель
+template<typename T>
+struct is_trivially_relocatable<boxed<T>> : std::true_type {};
+
+template<typename T>
+struct is_empty_after_move<boxed<T>> : std::true_type {};
+
+template<std::size_t Threshold, typename T>
+using box_if_larger_t = std::conditional_t<(sizeof(T) > Threshold), boxed<T>, T>;
+
+template<std::size_t Threshold, typename... Ts>
+using boxing_variant = variant<box_if_larger_t<Threshold, Ts>...>;
+
+} // end vr
+
+#endif // BOXED_H
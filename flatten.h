@@ -0,0 +1,203 @@
+#ifndef FLATTEN_H
+#define FLATTEN_H
+
+#include "variant.h"
+#include "variant_ref.h"
+
+namespace vr {
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Вложенные варианты как один плоский набор альтернатив:
+///
+///     using message = vr::variant<A, vr::variant<B, C>, vr::variant<D, vr::variant<E, F>>>;
+///     vr::flatten_t<message> == vr::variant<A, B, C, D, E, F>
+///
+/// Альтернативы нумеруются по порядку листьев (повторяющиеся типы не склеиваются), boxed<variant<...>> - лист.
+///
+/// visit_flat(f, v) вызывает f от листа через плоский индекс: f инстанцируется один раз на лист, а не на каждое
+/// сочетание уровней. Это удобство, а не ускорение: от одной диспетчеризации на весь путь отказались. Плоский
+/// индекс собирается диспетчеризацией на каждом уровне, где среди альтернатив есть вложенный вариант (на уровне
+/// из одних листьев - только чтение таблицы), и затем одна по плоскому индексу: для variant<A, variant<B, C>> это
+/// две диспетчеризации, как у двух visit. Сборка индекса без ветвлений (байты индексов по смещениям, известным при
+/// компиляции) сама по себе быстрее, но последний переход ждет ее результата, и по замерам (benchmark.cpp,
+/// "flatten: ") visit_flat так медленнее вложенных visit, которые процессор проходит спекулятивно. flatten(v) строит flatten_t<V> (перемещая лист, если v - rvalue), flatten_ref(v) - variant_ref
+/// на лист без копирования.
+///
+
+namespace details {
+
+    namespace flatten {
+
+        template<typename... Ts>
+        struct type_list {};
+
+        template<typename... Ls>
+        struct concat;
+
+        template<>
+        struct concat<> {
+            using type = type_list<>;
+        };
+
+        template<typename... Ts>
+        struct concat<type_list<Ts...>> {
+            using type = type_list<Ts...>;
+        };
+
+        template<typename... Ts, typename... Us, typename... Ls>
+        struct concat<type_list<Ts...>, type_list<Us...>, Ls...> {
+            using type = typename concat<type_list<Ts..., Us...>, Ls...>::type;
+        };
+
+        template<typename T>
+        struct leaves {
+            using type = type_list<T>;
+        };
+
+        template<typename... Ts>
+        struct leaves<variant<Ts...>> {
+            using type = typename concat<typename leaves<Ts>::type...>::type;
+        };
+
+        template<template<typename...> class V, typename L>
+        struct apply;
+
+        template<template<typename...> class V, typename... Ts>
+        struct apply<V, type_list<Ts...>> {
+            using type = V<Ts...>;
+        };
+
+        template<typename T>
+        inline constexpr bool is_variant_v = false;
+
+        template<typename... Ts>
+        inline constexpr bool is_variant_v<variant<Ts...>> = true;
+
+        template<typename T>
+        inline constexpr std::size_t leaf_count_v = 1;
+
+        template<typename... Ts>
+        inline constexpr std::size_t leaf_count_v<variant<Ts...>> = (leaf_count_v<Ts> + ...);
+
+        /// Есть ли среди альтернатив вложенный вариант
+        template<typename V>
+        inline constexpr bool has_nested_v = false;
+
+        template<typename... Ts>
+        inline constexpr bool has_nested_v<variant<Ts...>> = (is_variant_v<Ts> || ...);
+
+        /// Плоский индекс первого листа каждой альтернативы
+        template<typename V>
+        struct offsets;
+
+        template<typename... Ts>
+        struct offsets<variant<Ts...>> {
+            constexpr static std::array<std::size_t, sizeof...(Ts)> make() {
+                std::array<std::size_t, sizeof...(Ts)> result{};
+                std::size_t counts[] = {leaf_count_v<Ts>...};
+                for (std::size_t i = 1; i < sizeof...(Ts); ++i) result[i] = result[i - 1] + counts[i - 1];
+                return result;
+            }
+
+            constexpr static std::array<std::size_t, sizeof...(Ts)> value = make();
+
+            /// Альтернатива, в которой лежит лист L
+            constexpr static std::size_t owner(std::size_t L) {
+                std::size_t i = sizeof...(Ts) - 1;
+                while (value[i] > L) --i;
+                return i;
+            }
+        };
+
+        /// Плоский индекс активного листа или variant_npos, если какой-то уровень valueless_by_exception
+        template<typename V>
+        std::size_t leaf_index(V const& v) {
+            using offsets_t = offsets<V>;
+            if (v.valueless_by_exception()) return variant_npos;
+            if constexpr (!has_nested_v<V>) {
+                return v.index();   // одни листья: плоский индекс равен индексу уровня
+            } else {
+                return visitor::dispatch_index<V::size()>(v.index(), [&](auto I) -> std::size_t {
+                    constexpr std::size_t i = decltype(I)::value;
+                    if constexpr (is_variant_v<variant_alternative_t<i, V>>) {
+                        std::size_t inner = leaf_index(access::variant_helper::get_value<i>(v));
+                        return inner == variant_npos ? variant_npos : offsets_t::value[i] + inner;
+                    } else {
+                        return offsets_t::value[i];
+                    }
+                });
+            }
+        }
+
+        /// Объект альтернативы-листа L (для boxed - сам boxed), путь вычисляется при компиляции
+        template<std::size_t L, typename V>
+        constexpr decltype(auto) leaf(V&& v) {
+            using offsets_t = offsets<std::decay_t<V>>;
+            constexpr std::size_t i = offsets_t::owner(L);
+            if constexpr (is_variant_v<variant_alternative_t<i, std::decay_t<V>>>) {
+                return leaf<L - offsets_t::value[i]>(access::variant_helper::get_value<i>(std::forward<V>(v)));
+            } else {
+                return (access::variant_helper::get_alternative<i>(std::forward<V>(v)).value);
+            }
+        }
+
+        /// variant_ref на листья; boxed<T> лист - ссылка на сам T
+        template<bool Const, typename L>
+        struct ref_of;
+
+        template<bool Const, typename... Ts>
+        struct ref_of<Const, type_list<Ts...>> {
+            using type = std::conditional_t<Const, variant_ref<unboxed_t<Ts> const...>, variant_ref<unboxed_t<Ts>...>>;
+        };
+
+        template<typename V>
+        using ref_t = typename ref_of<std::is_const_v<V>, typename leaves<std::remove_const_t<V>>::type>::type;
+
+    } // end flatten
+
+} // details end
+
+template<typename V>
+using flatten_t = typename details::flatten::apply<variant, typename details::flatten::leaves<V>::type>::type;
+
+/////////////////////////////////////////////////////// Non-member functions //////////////////////////////////////////////////////////////////////////
+
+/// visit по листьям вложенных вариантов через плоский индекс листа
+template <visit_strategy S = visit_strategy::inline_switch, class Visitor, class Variant>
+decltype(auto) visit_flat(Visitor&& vis, Variant&& var) {
+    using V = std::decay_t<Variant>;
+    std::size_t index = details::flatten::leaf_index(var);
+    if (index == variant_npos) details::throw_bad_variant_access();
+    return details::visitor::dispatch_index<details::flatten::leaf_count_v<V>, S>(index, [&](auto L) -> decltype(auto) {
+        return std::invoke(std::forward<Visitor>(vis), details::unbox(details::flatten::leaf<decltype(L)::value>(std::forward<Variant>(var))));
+    });
+}
+
+/// Плоская копия (или перемещение листа из rvalue); valueless на любом уровне дает valueless результат
+template <class Variant>
+flatten_t<std::decay_t<Variant>> flatten(Variant&& var) {
+    using result_t = flatten_t<std::decay_t<Variant>>;
+    std::size_t index = details::flatten::leaf_index(var);
+    if (index == variant_npos) return details::access::variant_helper::make_valueless<result_t>();
+    return details::visitor::dispatch_index<result_t::size()>(index, [&](auto L) -> result_t {
+        return result_t(std::in_place_index<decltype(L)::value>, details::flatten::leaf<decltype(L)::value>(std::forward<Variant>(var)));
+    });
+}
+
+/// Ссылка на лист без копирования: variant_ref<A, B, ...> (для const варианта - const_variant_ref)
+template <class Variant>
+details::flatten::ref_t<Variant> flatten_ref(Variant& var) {
+    using result_t = details::flatten::ref_t<Variant>;
+    std::size_t index = details::flatten::leaf_index(var);
+    if (index == variant_npos) details::throw_bad_variant_access();
+    return details::visitor::dispatch_index<result_t::size()>(index, [&](auto L) -> result_t {
+        return result_t(std::in_place_index<decltype(L)::value>, details::unbox(details::flatten::leaf<decltype(L)::value>(var)));
+    });
+}
+
+/////////////////////////////////////////////////////// END Non-member functions //////////////////////////////////////////////////////////////////////////
+
+} // end vr
+
+#endif // FLATTEN_H
@@ -0,0 +1,308 @@
+#ifndef INTERN_POOL_H
+#define INTERN_POOL_H
+
+#include "variant.h"
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+namespace vr {
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// intern_pool<Ts...> хранит каждое различное значение variant<Ts...> один раз и выдает на него
+/// interned<Ts...> - ручку размером в указатель. Ручки сравниваются и хешируются по адресу значения,
+/// так что равенство двух интернированных строк - одно сравнение целых, а не visit и сравнение строк.
+///
+///     vr::intern_pool<int, double, std::string> pool(8);
+///     auto a = pool.intern(std::string("key"));
+///     auto b = pool.intern(std::string_view("key")); // найдено без построения variant: a == b
+///     vr::visit(printer(), a);
+///
+/// Значения разложены по шардам (по хешу). Поиск (find и первая проверка intern) не берет блокировок:
+/// таблица шарда - открытая адресация с атомарными слотами, новое значение публикуется release-записью
+/// указателя. Вставка берет мьютекс своего шарда, поэтому писатели из разных потоков редко мешают друг другу.
+/// При росте таблица копируется в новую вдвое больше, а старые живут до разрушения пула: читатель,
+/// который еще держит старую, видит корректный (хоть и неполный) набор и в худшем случае идет на медленный путь.
+///
+/// Ключом может быть variant<Ts...>, альтернатива или любой ключ, который понимают прозрачные
+/// hash<variant<Ts...>> / equal_to<variant<Ts...>> (std::string_view, const char* для строковой альтернативы).
+/// Значения живут, пока жив пул; ручки после разрушения пула недействительны.
+///
+
+template<typename... Ts>
+class intern_pool;
+
+template<typename... Ts>
+class interned {
+public:
+
+    using value_type = variant<Ts...>;
+
+    /// Пустая ручка (index() == variant_npos)
+    constexpr interned() noexcept : ptr(nullptr) {}
+
+    value_type const& value() const noexcept {
+        return *ptr;
+    }
+
+    value_type const& operator *() const noexcept { return *ptr; }
+    value_type const* operator ->() const noexcept { return ptr; }
+
+    /// Адрес значения в пуле - его идентичность
+    value_type const* get() const noexcept {
+        return ptr;
+    }
+
+    explicit operator bool() const noexcept {
+        return ptr != nullptr;
+    }
+
+    std::size_t index() const noexcept {
+        return ptr ? ptr->index() : variant_npos;
+    }
+
+    constexpr static std::size_t size() {
+        return sizeof...(Ts);
+    }
+
+    friend bool operator ==(interned a, interned b) noexcept { return a.ptr == b.ptr; }
+    friend bool operator !=(interned a, interned b) noexcept { return a.ptr != b.ptr; }
+
+    /// Порядок адресов: годится для упорядоченных контейнеров, но не совпадает с порядком значений
+    friend bool operator <(interned a, interned b) noexcept { return std::less<value_type const*>()(a.ptr, b.ptr); }
+
+private:
+
+    friend class intern_pool<Ts...>;
+
+    explicit interned(value_type const* p) noexcept : ptr(p) {}
+
+    value_type const* ptr;
+};
+
+template<typename... Ts>
+struct hash<interned<Ts...>> {
+    std::size_t operator()(interned<Ts...> h) const noexcept {
+        return std::hash<variant<Ts...> const*>()(h.get());
+    }
+};
+
+namespace details {
+
+    namespace intern {
+
+        /// Открытая адресация, линейное пробирование. Читают без блокировок, пишет только владелец мьютекса шарда.
+        /// Заполнение не больше половины, поэтому пустой слот, на котором поиск останавливается, всегда есть.
+        template<typename V>
+        struct table {
+
+            struct slot {
+                std::atomic<std::size_t> hash{0};
+                std::atomic<V const*> value{nullptr};
+            };
+
+            explicit table(std::size_t capacity) : mask(capacity - 1), slots(new slot[capacity]) {}
+
+            std::size_t capacity() const noexcept {
+                return mask + 1;
+            }
+
+            template<typename K, typename Eq>
+            V const* find(std::size_t h, K const& key, Eq const& equal) const {
+                for (std::size_t i = h & mask;; i = (i + 1) & mask) {
+                    V const* v = slots[i].value.load(std::memory_order_acquire);
+                    if (!v) return nullptr;
+                    if (slots[i].hash.load(std::memory_order_relaxed) == h && equal(*v, key)) return v;
+                }
+            }
+
+            /// Хеш пишется до release-записи указателя: читатель, увидевший указатель, видит и хеш
+            void insert(std::size_t h, V const* v) noexcept {
+                for (std::size_t i = h & mask;; i = (i + 1) & mask) {
+                    if (!slots[i].value.load(std::memory_order_relaxed)) {
+                        slots[i].hash.store(h, std::memory_order_relaxed);
+                        slots[i].value.store(v, std::memory_order_release);
+                        ++used;
+                        return;
+                    }
+                }
+            }
+
+            std::size_t mask;
+            std::unique_ptr<slot[]> slots;
+            std::size_t used = 0;
+        };
+
+        template<typename V>
+        struct shard {
+            constexpr static std::size_t initial_capacity = 64;
+
+            shard() {
+                tables.push_back(std::make_unique<table<V>>(initial_capacity));
+                current.store(tables.back().get(), std::memory_order_relaxed);
+            }
+
+            /// Вызывается под lock
+            table<V>* grow() {
+                table<V> const& old = *tables.back();
+                tables.push_back(std::make_unique<table<V>>(old.capacity() * 2));
+                table<V>* bigger = tables.back().get();
+                for (std::size_t i = 0; i < old.capacity(); ++i) {
+                    if (V const* v = old.slots[i].value.load(std::memory_order_relaxed)) {
+                        bigger->insert(old.slots[i].hash.load(std::memory_order_relaxed), v);
+                    }
+                }
+                current.store(bigger, std::memory_order_release);
+                return bigger;
+            }
+
+            std::atomic<table<V>*> current{nullptr};
+            std::mutex lock;
+            std::deque<V> values;                           // адреса элементов не меняются при push_back
+            std::vector<std::unique_ptr<table<V>>> tables;  // все таблицы: старые могут еще читать
+        };
+
+    } // end intern
+
+} // details end
+
+template<typename... Ts>
+class intern_pool {
+public:
+
+    using value_type = variant<Ts...>;
+    using handle = interned<Ts...>;
+
+    /// shards - число независимых шардов (со своим мьютексом вставки), обычно порядка числа пишущих потоков
+    explicit intern_pool(std::size_t shards = 1)
+        : shard_count(shards ? shards : 1), parts(new details::intern::shard<value_type>[shard_count]) {}
+
+    intern_pool(intern_pool const&) = delete;
+    intern_pool& operator =(intern_pool const&) = delete;
+
+    /// Ручка значения key; если такого еще нет - сохраняет его
+    template<typename K>
+    handle intern(K&& key) {
+        std::size_t h = hasher(key);
+        auto& part = shard_for(h);
+        if (value_type const* v = part.current.load(std::memory_order_acquire)->find(h, key, equal)) {
+            return handle(v);
+        }
+
+        std::lock_guard<std::mutex> guard(part.lock);
+        auto* t = part.current.load(std::memory_order_relaxed);
+        if (value_type const* v = t->find(h, key, equal)) {
+            return handle(v);
+        }
+        value_type const* v = &part.values.emplace_back(make(std::forward<K>(key)));
+        if (2 * (t->used + 1) > t->capacity()) {
+            t = part.grow();
+        }
+        t->insert(h, v);
+        count.fetch_add(1, std::memory_order_relaxed);
+        return handle(v);
+    }
+
+    /// Ручка значения key или пустая ручка; без блокировок
+    template<typename K>
+    handle find(K const& key) const {
+        std::size_t h = hasher(key);
+        return handle(shard_for(h).current.load(std::memory_order_acquire)->find(h, key, equal));
+    }
+
+    /// Число различных значений
+    std::size_t size() const noexcept {
+        return count.load(std::memory_order_relaxed);
+    }
+
+    std::size_t shards() const noexcept {
+        return shard_count;
+    }
+
+    /// Число значений в шарде i - видно, насколько ровно хеш раскладывает ключи
+    std::size_t shard_size(std::size_t i) const {
+        std::lock_guard<std::mutex> guard(parts[i].lock);
+        return parts[i].values.size();
+    }
+
+private:
+
+    /// Младшие биты хеша выбирают слот в таблице, шард - старшие биты произведения на нечетную константу
+    /// (мультипликативное хеширование): у std::hash<int> - тождества - старшие биты самого хеша нулевые
+    details::intern::shard<value_type>& shard_for(std::size_t h) const noexcept {
+        std::size_t mixed = h * static_cast<std::size_t>(0x9e3779b97f4a7c15ull);
+        return parts[(mixed >> (sizeof(std::size_t) * 4)) % shard_count];
+    }
+
+    template<typename K>
+    static value_type make(K&& key) {
+        if constexpr (std::is_same_v<std::decay_t<K>, value_type>) {
+            return std::forward<K>(key);
+        } else {
+            return value_type(std::in_place_index<details::hashing::lookup_index_v<std::decay_t<K>, Ts...>>, std::forward<K>(key));
+        }
+    }
+
+    hash<value_type> hasher;
+    equal_to<value_type> equal;
+    std::size_t shard_count;
+    std::unique_ptr<details::intern::shard<value_type>[]> parts;
+    std::atomic<std::size_t> count{0};
+};
+
+template<typename... Ts>
+struct variant_size<interned<Ts...>> : std::integral_constant<std::size_t, sizeof...(Ts)> {};
+
+template<std::size_t I, typename... Ts>
+struct variant_alternative<I, interned<Ts...>> {
+    using type = details::get_type_at_t<I, Ts...>;
+};
+
+/////////////////////////////////////////////////////// Non-member functions //////////////////////////////////////////////////////////////////////////
+
+/// По значению: так перегрузка точнее общего visit(Visitor&&, Variants&&...) для любой категории значения
+template <class Visitor, class... Ts>
+decltype(auto) visit(Visitor&& vis, interned<Ts...> h) {
+    return vr::visit(std::forward<Visitor>(vis), h.value());
+}
+
+template <typename T, typename... Ts>
+bool holds_alternative(interned<Ts...> h) noexcept {
+    return details::alternative_index_v<T, Ts...> == h.index();
+}
+
+template <std::size_t I, class... Types>
+decltype(auto) get(interned<Types...> h) {
+    if (h.index() != I) details::throw_bad_variant_access();
+    return get<I>(h.value());
+}
+
+template <class T, class... Types, std::size_t I = details::alternative_index_v<T, Types...>>
+T const& get(interned<Types...> h) {
+    return get<I>(h);
+}
+
+template <std::size_t I, class... Types>
+auto get_if(interned<Types...> const* ph) noexcept {
+    return ph && ph->index() == I ? get_if<I>(ph->get()) : nullptr;
+}
+
+template <class T, class... Types>
+auto get_if(interned<Types...> const* ph) noexcept {
+    return get_if<details::alternative_index_v<T, Types...>>(ph);
+}
+
+/////////////////////////////////////////////////////// END Non-member functions //////////////////////////////////////////////////////////////////////////
+
+} // end vr
+
+namespace std {
+
+template<typename... Ts>
+struct hash<vr::interned<Ts...>> : vr::hash<vr::interned<Ts...>> {};
+
+} // end std
+
+#endif // INTERN_POOL_H
@@ -1,5 +1,17 @@
 #include <bits/stdc++.h>
 #include "variant.h"
+#include "ptr_variant.h"
+#include "nanbox_variant.h"
+#include "strict_variant.h"
+#include "boxed.h"
+#include "allocator_variant.h"
+#include "shared_variant.h"
+#include "variant_ref.h"
+#include "flatten.h"
+#include "transform.h"
+#include "intern_pool.h"
+#include "variant_vector.h"
+#include "tag_scan.h"
 #include <variant>
 #include "gtest/gtest.h"
 #include "tst_adf.h"
@@ -0,0 +1,295 @@
+#ifndef NANBOX_VARIANT_H
+#define NANBOX_VARIANT_H
+
+#include "variant.h"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+
+namespace vr {
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// nanbox_variant<double, int32_t, bool, monostate, Object*> - variant в одном 64-битном слове.
+/// double хранится как есть (все NaN приводятся к одному каноническому положительному quiet NaN),
+/// остальные альтернативы кодируются в payload отрицательного quiet NaN:
+///
+///     1 11111111111 1 ttt pppp...p
+///     |      |      |  |     |
+///     знак  порядок |  |   48 бит значения (nanbox_traits<T>::encode)
+///                 quiet индекс альтернативы
+///
+/// Альтернатив не больше 8, ровно одна из них double. Для своего типа нужно специализировать
+/// nanbox_traits<T> (encode в 48 бит и decode обратно); из коробки есть целые до 32 бит, bool,
+/// пустые теги (monostate) и указатели (48-битное адресное пространство, как на x86-64 и AArch64).
+///
+/// Значения хранятся закодированными, поэтому get возвращает копию, а get_if - std::optional
+/// (пишется так же, как с указателем: if (auto p = get_if<int>(&v)) *p).
+///
+
+template<typename T, typename = void>
+struct nanbox_traits;
+
+template<typename T>
+struct nanbox_traits<T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool> && sizeof(T) <= 4>> {
+    constexpr static std::uint64_t encode(T value) noexcept {
+        return static_cast<std::make_unsigned_t<T>>(value);
+    }
+    constexpr static T decode(std::uint64_t payload) noexcept {
+        return static_cast<T>(static_cast<std::make_unsigned_t<T>>(payload));
+    }
+};
+
+template<>
+struct nanbox_traits<bool> {
+    constexpr static std::uint64_t encode(bool value) noexcept { return value; }
+    constexpr static bool decode(std::uint64_t payload) noexcept { return payload != 0; }
+};
+
+template<typename T>
+struct nanbox_traits<T, std::enable_if_t<details::storage::is_tag_type_v<T>>> {
+    constexpr static std::uint64_t encode(T) noexcept { return 0; }
+    constexpr static T decode(std::uint64_t) noexcept { return T{}; }
+};
+
+template<typename T>
+struct nanbox_traits<T*> {
+    /// Указатель должен помещаться в 48 бит payload: старшие биты иначе пропали бы молча
+    static std::uint64_t encode(T* value) noexcept {
+        std::uint64_t address = reinterpret_cast<std::uintptr_t>(value);
+        assert((address >> 48) == 0 && "nanbox_variant: pointer does not fit in 48 bits");
+        return address;
+    }
+    static T* decode(std::uint64_t payload) noexcept { return reinterpret_cast<T*>(static_cast<std::uintptr_t>(payload)); }
+};
+
+template<typename... Ts>
+struct nanbox_variant;
+
+template<typename... Ts>
+struct variant_size<nanbox_variant<Ts...>> : std::integral_constant<std::size_t, sizeof...(Ts)> {};
+
+template<std::size_t I, typename... Ts>
+struct variant_alternative<I, nanbox_variant<Ts...>> {
+    using type = details::get_type_at_t<I, Ts...>;
+};
+
+namespace details {
+
+    namespace nanbox {
+
+        constexpr std::uint64_t boxed_mask    = 0xFFF8000000000000ull;
+        constexpr std::uint64_t payload_mask  = 0x0000FFFFFFFFFFFFull;
+        constexpr std::uint64_t canonical_nan = 0x7FF8000000000000ull;
+        constexpr unsigned      tag_shift     = 48;
+
+        inline std::uint64_t encode_double(double value) noexcept {
+            if (std::isnan(value)) return canonical_nan;
+            std::uint64_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            return bits;
+        }
+
+        inline double decode_double(std::uint64_t bits) noexcept {
+            double value;
+            std::memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+
+        template<std::size_t I, typename T>
+        std::uint64_t encode(T const& value) noexcept {
+            if constexpr (std::is_same_v<T, double>) {
+                return encode_double(value);
+            } else {
+                return boxed_mask | (std::uint64_t(I) << tag_shift) | (nanbox_traits<T>::encode(value) & payload_mask);
+            }
+        }
+
+        template<typename T>
+        T decode(std::uint64_t bits) noexcept {
+            if constexpr (std::is_same_v<T, double>) {
+                return decode_double(bits);
+            } else {
+                return nanbox_traits<T>::decode(bits & payload_mask);
+            }
+        }
+
+        template<typename Visitor, typename... Ts>
+        struct dispatcher {
+            template<std::size_t I>
+            static decltype(auto) call(Visitor&& visitor, std::uint64_t bits) {
+                return std::invoke(std::forward<Visitor>(visitor), decode<get_type_at_t<I, Ts...>>(bits));
+            }
+
+            template<visit_strategy S, std::size_t... Is>
+            static decltype(auto) visit(Visitor&& visitor, std::size_t index, std::uint64_t bits, std::index_sequence<Is...>) {
+                using result_t = decltype(call<0>(std::forward<Visitor>(visitor), bits));
+                static_assert((std::is_same_v<result_t, decltype(call<Is>(std::forward<Visitor>(visitor), bits))> && ...),
+                              "`visit` requires the visitor to have a single return type.");
+                return visitor::dispatch_index<sizeof...(Ts), S>(index, [&](auto I) -> decltype(auto) {
+                    return call<decltype(I)::value>(std::forward<Visitor>(visitor), bits);
+                });
+            }
+        };
+
+    } // end nanbox
+
+} // details end
+
+template<typename... Ts>
+struct nanbox_variant {
+
+    static_assert(0 < sizeof...(Ts) && sizeof...(Ts) <= 8, "nanbox_variant holds from 1 to 8 alternatives");
+    static_assert(details::not_unique_type<double, Ts...>::value == 1, "nanbox_variant needs exactly one double alternative");
+
+    constexpr static std::size_t double_index = details::get_id_at_v<double, Ts...>;
+
+    nanbox_variant() noexcept : bits(details::nanbox::encode<0>(details::get_type_at_t<0, Ts...>{})) {}
+
+    template<typename T,
+             std::enable_if_t<details::find_type_v<T, Ts...>>* = nullptr,
+             std::size_t I = details::get_id_at_v<T, Ts...>>
+    nanbox_variant(T value) noexcept : bits(details::nanbox::encode<I>(value)) {}
+
+    template<std::size_t I, typename... As, typename T = details::get_type_at_t<I, Ts...>>
+    explicit nanbox_variant(std::in_place_index_t<I>, As&&... args) : bits(details::nanbox::encode<I>(T(std::forward<As>(args)...))) {}
+
+    template<typename T, typename... As, std::size_t I = details::get_id_at_v<T, Ts...>>
+    explicit nanbox_variant(std::in_place_type_t<T>, As&&... args) : bits(details::nanbox::encode<I>(T(std::forward<As>(args)...))) {}
+
+    nanbox_variant(nanbox_variant const&) = default;
+    nanbox_variant& operator =(nanbox_variant const&) = default;
+
+    template<typename T,
+             std::enable_if_t<details::find_type_v<T, Ts...>>* = nullptr,
+             std::size_t I = details::get_id_at_v<T, Ts...>>
+    nanbox_variant& operator =(T value) noexcept {
+        bits = details::nanbox::encode<I>(value);
+        return *this;
+    }
+
+    template<std::size_t I, typename... As, typename T = details::get_type_at_t<I, Ts...>>
+    T emplace(As&&... args) {
+        T value(std::forward<As>(args)...);
+        bits = details::nanbox::encode<I>(value);
+        return value;
+    }
+
+    template<typename T, typename... As, std::size_t I = details::get_id_at_v<T, Ts...>>
+    T emplace(As&&... args) {
+        return emplace<I>(std::forward<As>(args)...);
+    }
+
+    std::size_t index() const noexcept {
+        if ((bits & details::nanbox::boxed_mask) != details::nanbox::boxed_mask)
+            return double_index;
+        return static_cast<std::size_t>((bits >> details::nanbox::tag_shift) & 7);
+    }
+
+    constexpr bool valueless_by_exception() const noexcept {
+        return false;
+    }
+
+    constexpr static std::size_t size() {
+        return sizeof...(Ts);
+    }
+
+    void swap(nanbox_variant& rhs) noexcept {
+        std::swap(bits, rhs.bits);
+    }
+
+    /// Значение альтернативы I, без проверки индекса
+    template<std::size_t I>
+    details::get_type_at_t<I, Ts...> value() const noexcept {
+        return details::nanbox::decode<details::get_type_at_t<I, Ts...>>(bits);
+    }
+
+    template<visit_strategy S = visit_strategy::inline_switch, typename Visitor>
+    decltype(auto) visit(Visitor&& visitor) const {
+        return details::nanbox::dispatcher<Visitor, Ts...>::template visit<S>(std::forward<Visitor>(visitor), index(), bits, std::index_sequence_for<Ts...>());
+    }
+
+    /// Упакованные альтернативы равны, когда равны их слова; double сравнивается как double (+0 == -0, NaN != NaN)
+    friend bool operator ==(nanbox_variant const& v, nanbox_variant const& w) noexcept {
+        if (v.index() == double_index && w.index() == double_index)
+            return std::equal_to<double>()(v.template value<double_index>(), w.template value<double_index>());
+        return v.bits == w.bits;
+    }
+
+    friend bool operator !=(nanbox_variant const& v, nanbox_variant const& w) noexcept {
+        return !(v == w);
+    }
+
+private:
+
+    std::uint64_t bits;
+};
+
+/////////////////////////////////////////////////////// Non-member functions //////////////////////////////////////////////////////////////////////////
+
+template <class Visitor, class... Ts>
+decltype(auto) visit(Visitor&& vis, nanbox_variant<Ts...>& v) {
+    return v.visit(std::forward<Visitor>(vis));
+}
+
+template <class Visitor, class... Ts>
+decltype(auto) visit(Visitor&& vis, nanbox_variant<Ts...> const& v) {
+    return v.visit(std::forward<Visitor>(vis));
+}
+
+template <class Visitor, class... Ts>
+decltype(auto) visit(Visitor&& vis, nanbox_variant<Ts...>&& v) {
+    return v.visit(std::forward<Visitor>(vis));
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+template <typename T, typename... Ts>
+bool holds_alternative(nanbox_variant<Ts...> const& v) noexcept {
+    return details::get_id_at_v<T, Ts...> == v.index();
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+template <std::size_t I, class... Types>
+variant_alternative_t<I, nanbox_variant<Types...>> get(nanbox_variant<Types...> const& v) {
+    if (v.index() == I)
+        return v.template value<I>();
+    else
+        details::throw_bad_variant_access();
+}
+
+template <class T, class... Types, std::size_t I = details::get_id_at_v<T, Types...>>
+T get(nanbox_variant<Types...> const& v) {
+    return get<I>(v);
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+template <std::size_t I, class... Types>
+std::optional<variant_alternative_t<I, nanbox_variant<Types...>>> get_if(const nanbox_variant<Types...>* pv) noexcept {
+    if (!pv) return std::nullopt;
+    if (pv->index() == I) {
+        return pv->template value<I>();
+    } else
+        return std::nullopt;
+}
+
+template <class T, class... Types>
+std::optional<T> get_if(const nanbox_variant<Types...>* pv) noexcept {
+    return get_if<details::get_id_at_v<T, Types...>>(pv);
+}
+
+//////////////////////////////////////////////////////////////
+
+template <class... Types>
+void swap(nanbox_variant<Types...>& lhs, nanbox_variant<Types...>& rhs) noexcept {
+    lhs.swap(rhs);
+}
+
+/////////////////////////////////////////////////////// END Non-member functions //////////////////////////////////////////////////////////////////////////
+
+} // end vr
+
+#endif // NANBOX_VARIANT_H
@@ -0,0 +1,225 @@
+#ifndef PTR_VARIANT_H
+#define PTR_VARIANT_H
+
+#include "variant.h"
+#include <cstdint>
+
+namespace vr {
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// ptr_variant<A*, B*, ...> - variant только из указателей, занимающий одно машинное слово:
+/// индекс альтернативы хранится в младших битах указателя, которые всегда нулевые из-за выравнивания.
+/// Поэтому alignof каждого pointee должен быть не меньше 2^ceil(log2(sizeof...(Ts)))
+/// (проверяется при конструировании, так что pointee может быть неполным в месте объявления ptr_variant).
+///
+/// get / get_if возвращают сам указатель (а не ссылку/указатель на него - отдельного объекта-указателя нет),
+/// visit передает visitor'у указатель по значению.
+///
+
+template<typename... Ts>
+struct ptr_variant;
+
+template<typename... Ts>
+struct variant_size<ptr_variant<Ts...>> : std::integral_constant<std::size_t, sizeof...(Ts)> {};
+
+template<std::size_t I, typename... Ts>
+struct variant_alternative<I, ptr_variant<Ts...>> {
+    using type = details::get_type_at_t<I, Ts...>;
+};
+
+namespace details {
+
+    namespace ptr_tag {
+
+        constexpr std::size_t bits_for(std::size_t n) {
+            std::size_t bits = 0;
+            while ((std::size_t(1) << bits) < n) ++bits;
+            return bits;
+        }
+
+        template<std::size_t N>
+        inline constexpr std::uintptr_t mask = (std::uintptr_t(1) << bits_for(N)) - 1;
+
+        template<typename T, std::size_t N>
+        inline constexpr bool fits_v = alignof(std::remove_pointer_t<T>) > mask<N>;
+
+        template<typename T, std::size_t N>
+        std::uintptr_t pack(T p, std::size_t index) noexcept {
+            static_assert(fits_v<T, N>, "pointee alignment is too small to hold the alternative index in the low bits");
+            return reinterpret_cast<std::uintptr_t>(p) | index;
+        }
+
+        template<typename T, std::size_t N>
+        T unpack(std::uintptr_t word) noexcept {
+            return reinterpret_cast<T>(word & ~mask<N>);
+        }
+
+        template<typename Visitor, typename... Ts>
+        struct dispatcher {
+            template<std::size_t I>
+            static decltype(auto) call(Visitor&& visitor, std::uintptr_t word) {
+                return std::invoke(std::forward<Visitor>(visitor), unpack<get_type_at_t<I, Ts...>, sizeof...(Ts)>(word));
+            }
+
+            template<visit_strategy S, std::size_t... Is>
+            static decltype(auto) visit(Visitor&& visitor, std::uintptr_t word, std::index_sequence<Is...>) {
+                using result_t = decltype(call<0>(std::forward<Visitor>(visitor), word));
+                static_assert((std::is_same_v<result_t, decltype(call<Is>(std::forward<Visitor>(visitor), word))> && ...),
+                              "`visit` requires the visitor to have a single return type.");
+                return visitor::dispatch_index<sizeof...(Ts), S>(word & mask<sizeof...(Ts)>, [&](auto I) -> decltype(auto) {
+                    return call<decltype(I)::value>(std::forward<Visitor>(visitor), word);
+                });
+            }
+        };
+
+    } // end ptr_tag
+
+} // details end
+
+template<typename... Ts>
+struct ptr_variant {
+
+    static_assert(0 < sizeof...(Ts), "ptr_variant must have at least one alternative");
+    static_assert((std::is_pointer_v<Ts> && ...), "ptr_variant alternatives must be object pointers");
+
+    /// Первая альтернатива, nullptr
+    constexpr ptr_variant() noexcept : word(0) {}
+
+    template<typename T,
+             std::enable_if_t<details::find_type_v<T, Ts...> && std::is_pointer_v<T>>* = nullptr,
+             std::size_t I = details::get_id_at_v<T, Ts...>>
+    ptr_variant(T p) noexcept : word(details::ptr_tag::pack<T, sizeof...(Ts)>(p, I)) {}
+
+    template<std::size_t I, typename T = details::get_type_at_t<I, Ts...>>
+    explicit ptr_variant(std::in_place_index_t<I>, T p) noexcept : word(details::ptr_tag::pack<T, sizeof...(Ts)>(p, I)) {}
+
+    template<typename T, std::size_t I = details::get_id_at_v<T, Ts...>>
+    explicit ptr_variant(std::in_place_type_t<T>, T p) noexcept : word(details::ptr_tag::pack<T, sizeof...(Ts)>(p, I)) {}
+
+    ptr_variant(ptr_variant const&) = default;
+    ptr_variant& operator =(ptr_variant const&) = default;
+
+    template<typename T,
+             std::enable_if_t<details::find_type_v<T, Ts...> && std::is_pointer_v<T>>* = nullptr,
+             std::size_t I = details::get_id_at_v<T, Ts...>>
+    ptr_variant& operator =(T p) noexcept {
+        word = details::ptr_tag::pack<T, sizeof...(Ts)>(p, I);
+        return *this;
+    }
+
+    template<std::size_t I, typename T = details::get_type_at_t<I, Ts...>>
+    T emplace(T p) noexcept {
+        word = details::ptr_tag::pack<T, sizeof...(Ts)>(p, I);
+        return p;
+    }
+
+    template<typename T, std::size_t I = details::get_id_at_v<T, Ts...>>
+    T emplace(T p) noexcept {
+        return emplace<I>(p);
+    }
+
+    constexpr std::size_t index() const noexcept {
+        return static_cast<std::size_t>(word & details::ptr_tag::mask<sizeof...(Ts)>);
+    }
+
+    constexpr bool valueless_by_exception() const noexcept {
+        return false;
+    }
+
+    constexpr static std::size_t size() {
+        return sizeof...(Ts);
+    }
+
+    void swap(ptr_variant& rhs) noexcept {
+        std::swap(word, rhs.word);
+    }
+
+    /// Указатель активной альтернативы I, без проверки индекса
+    template<std::size_t I>
+    details::get_type_at_t<I, Ts...> pointer() const noexcept {
+        return details::ptr_tag::unpack<details::get_type_at_t<I, Ts...>, sizeof...(Ts)>(word);
+    }
+
+    template<visit_strategy S = visit_strategy::inline_switch, typename Visitor>
+    decltype(auto) visit(Visitor&& visitor) const {
+        return details::ptr_tag::dispatcher<Visitor, Ts...>::template visit<S>(std::forward<Visitor>(visitor), word, std::index_sequence_for<Ts...>());
+    }
+
+    friend bool operator ==(ptr_variant const& v, ptr_variant const& w) noexcept { return v.word == w.word; }
+    friend bool operator !=(ptr_variant const& v, ptr_variant const& w) noexcept { return v.word != w.word; }
+
+private:
+
+    std::uintptr_t word;
+};
+
+/////////////////////////////////////////////////////// Non-member functions //////////////////////////////////////////////////////////////////////////
+
+/// Перегрузки для всех категорий значения, иначе общий visit(Visitor&&, Variants&&...) окажется точнее
+
+template <class Visitor, class... Ts>
+decltype(auto) visit(Visitor&& vis, ptr_variant<Ts...>& v) {
+    return v.visit(std::forward<Visitor>(vis));
+}
+
+template <class Visitor, class... Ts>
+decltype(auto) visit(Visitor&& vis, ptr_variant<Ts...> const& v) {
+    return v.visit(std::forward<Visitor>(vis));
+}
+
+template <class Visitor, class... Ts>
+decltype(auto) visit(Visitor&& vis, ptr_variant<Ts...>&& v) {
+    return v.visit(std::forward<Visitor>(vis));
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+template <typename T, typename... Ts>
+constexpr bool holds_alternative(ptr_variant<Ts...> const& v) noexcept {
+    return details::get_id_at_v<T, Ts...> == v.index();
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+template <std::size_t I, class... Types>
+variant_alternative_t<I, ptr_variant<Types...>> get(ptr_variant<Types...> const& v) {
+    if (v.index() == I)
+        return v.template pointer<I>();
+    else
+        details::throw_bad_variant_access();
+}
+
+template <class T, class... Types, std::size_t I = details::get_id_at_v<T, Types...>>
+T get(ptr_variant<Types...> const& v) {
+    return get<I>(v);
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+template <std::size_t I, class... Types>
+variant_alternative_t<I, ptr_variant<Types...>> get_if(const ptr_variant<Types...>* pv) noexcept {
+    if (!pv) return nullptr;
+    if (pv->index() == I) {
+        return pv->template pointer<I>();
+    } else
+        return nullptr;
+}
+
+template <class T, class... Types>
+T get_if(const ptr_variant<Types...>* pv) noexcept {
+    return get_if<details::get_id_at_v<T, Types...>>(pv);
+}
+
+//////////////////////////////////////////////////////////////
+
+template <class... Types>
+void swap(ptr_variant<Types...>& lhs, ptr_variant<Types...>& rhs) noexcept {
+    lhs.swap(rhs);
+}
+
+/////////////////////////////////////////////////////// END Non-member functions //////////////////////////////////////////////////////////////////////////
+
+} // end vr
+
+#endif // PTR_VARIANT_H
@@ -0,0 +1,308 @@
+#ifndef SHARED_VARIANT_H
+#define SHARED_VARIANT_H
+
+#include "variant.h"
+#include <atomic>
+
+namespace vr {
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// shared_variant<Ts...> - variant с копированием при записи: копии делят одно неизменяемое значение
+/// (указатель на блок со счетчиком ссылок и variant<Ts...>), так что раздача одного значения N потребителям -
+/// это N инкрементов счетчика, а не N глубоких копий строк и векторов.
+///
+/// Чтение (visit, get/get_if от const объекта, index) значение не копирует; visit всегда видит const&.
+/// Изменяющий доступ (get/get_if от не-const объекта, mutate()) сначала отделяет свою копию, если значение
+/// кому-то еще нужно. emplace и присваивание новой альтернативы старое значение не копируют вовсе:
+/// у единственного владельца меняют его на месте, иначе просто строят новый блок.
+///
+/// Счетчик атомарный; пока владелец один, освобождение обходится без атомарной read-modify-write операции.
+/// local_shared_variant<Ts...> - то же с обычным счетчиком для значений, не покидающих поток.
+///
+/// Перемещенный shared_variant пуст и ведет себя как valueless_by_exception вариант: value() - вариант
+/// без значения, visit и get бросают bad_variant_access, а присваивание, emplace и mutate() снова дают ему значение.
+///
+
+namespace details {
+
+    namespace shared {
+
+        struct atomic_count {
+            std::atomic<std::size_t> n{1};
+
+            std::size_t get() const noexcept {
+                return n.load(std::memory_order_acquire);
+            }
+
+            void acquire() noexcept {
+                n.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            /// true, если ссылка была последней. Единственный владелец не может конкурировать с acquire:
+            /// для acquire нужна еще одна ссылка
+            bool release() noexcept {
+                if (get() == 1) return true;
+                return n.fetch_sub(1, std::memory_order_acq_rel) == 1;
+            }
+        };
+
+        struct local_count {
+            std::size_t n = 1;
+
+            std::size_t get() const noexcept { return n; }
+            void acquire() noexcept { ++n; }
+            bool release() noexcept { return --n == 0; }
+        };
+
+        template<typename Count, typename... Ts>
+        struct block {
+            template<typename... As>
+            explicit block(As&&... args) : value(std::forward<As>(args)...) {}
+
+            Count count;
+            variant<Ts...> value;
+        };
+
+    } // end shared
+
+} // details end
+
+template<typename Count, typename... Ts>
+struct basic_shared_variant {
+
+    using variant_type = variant<Ts...>;
+
+//////////////////////////// Constructors ///////////////////////////////////
+
+    basic_shared_variant() : ptr(new block_type()) {}
+
+    template <typename T,
+              std::enable_if_t<!std::is_same_v<std::decay_t<T>, basic_shared_variant> &&
+                               std::is_constructible_v<variant_type, T>>* = nullptr>
+    basic_shared_variant(T&& arg) : ptr(new block_type(std::forward<T>(arg))) {}
+
+    template <typename T, typename... As>
+    explicit basic_shared_variant(std::in_place_type_t<T> tag, As&&... args) : ptr(new block_type(tag, std::forward<As>(args)...)) {}
+
+    template <std::size_t I, typename... As>
+    explicit basic_shared_variant(std::in_place_index_t<I> tag, As&&... args) : ptr(new block_type(tag, std::forward<As>(args)...)) {}
+
+    basic_shared_variant(basic_shared_variant const& other) noexcept : ptr(other.ptr) {
+        if (ptr) ptr->count.acquire();
+    }
+
+    basic_shared_variant(basic_shared_variant&& other) noexcept : ptr(std::exchange(other.ptr, nullptr)) {}
+
+    ~basic_shared_variant() {
+        reset();
+    }
+
+//////////////////////////// Assignment ///////////////////////////////////
+
+    basic_shared_variant& operator =(basic_shared_variant const& rhs) noexcept {
+        basic_shared_variant copy(rhs);
+        swap(copy);
+        return *this;
+    }
+
+    basic_shared_variant& operator =(basic_shared_variant&& rhs) noexcept {
+        basic_shared_variant moved(std::move(rhs));
+        swap(moved);
+        return *this;
+    }
+
+    template <typename A,
+              std::enable_if_t<!std::is_same_v<std::decay_t<A>, basic_shared_variant> &&
+                               std::is_assignable_v<variant_type&, A>>* = nullptr>
+    basic_shared_variant& operator =(A&& arg) {
+        if (unique()) {
+            ptr->value = std::forward<A>(arg);
+        } else {
+            basic_shared_variant fresh(std::forward<A>(arg));
+            swap(fresh);
+        }
+        return *this;
+    }
+
+//////////////////////////// Modifiers ///////////////////////////////////
+
+    template <std::size_t I, typename... As>
+    decltype(auto) emplace(As&&... args) {
+        if (!unique()) {
+            basic_shared_variant fresh(std::in_place_index<I>, std::forward<As>(args)...);
+            swap(fresh);
+            return details::access::variant_helper::get_value<I>(ptr->value);
+        }
+        return ptr->value.template emplace<I>(std::forward<As>(args)...);
+    }
+
+    template <typename T, typename... As, std::size_t I = details::alternative_index_v<T, Ts...>>
+    T& emplace(As&&... args) {
+        return emplace<I>(std::forward<As>(args)...);
+    }
+
+    /// Значение для изменения: своя копия, если блок делят несколько владельцев
+    variant_type& mutate() {
+        if (!ptr) {
+            ptr = new block_type(details::access::variant_helper::make_valueless<variant_type>());
+        } else if (!unique()) {
+            block_type* copy = new block_type(ptr->value);
+            reset();
+            ptr = copy;
+        }
+        return ptr->value;
+    }
+
+    void swap(basic_shared_variant& rhs) noexcept {
+        std::swap(ptr, rhs.ptr);
+    }
+
+//////////////////////////// Observers ///////////////////////////////////
+
+    /// Общее неизменяемое значение
+    variant_type const& value() const noexcept {
+        return ptr ? ptr->value : empty();
+    }
+
+    std::size_t index() const noexcept {
+        return ptr ? ptr->value.index() : variant_npos;
+    }
+
+    bool valueless_by_exception() const noexcept {
+        return !ptr || ptr->value.valueless_by_exception();
+    }
+
+    constexpr static std::size_t size() {
+        return sizeof...(Ts);
+    }
+
+    bool unique() const noexcept {
+        return ptr && ptr->count.get() == 1;
+    }
+
+    std::size_t use_count() const noexcept {
+        return ptr ? ptr->count.get() : 0;
+    }
+
+private:
+
+    using block_type = details::shared::block<Count, Ts...>;
+
+    /// value() перемещенного объекта
+    static variant_type const& empty() noexcept {
+        static variant_type const instance = details::access::variant_helper::make_valueless<variant_type>();
+        return instance;
+    }
+
+    void reset() noexcept {
+        if (ptr && ptr->count.release()) delete ptr;
+        ptr = nullptr;
+    }
+
+    block_type* ptr;
+};
+
+template<typename... Ts>
+using shared_variant = basic_shared_variant<details::shared::atomic_count, Ts...>;
+
+template<typename... Ts>
+using local_shared_variant = basic_shared_variant<details::shared::local_count, Ts...>;
+
+template<typename Count, typename... Ts>
+struct variant_size<basic_shared_variant<Count, Ts...>> : std::integral_constant<std::size_t, sizeof...(Ts)> {};
+
+template<std::size_t I, typename Count, typename... Ts>
+struct variant_alternative<I, basic_shared_variant<Count, Ts...>> {
+    using type = details::get_type_at_t<I, Ts...>;
+};
+
+/////////////////////////////////////////////////////// Non-member functions //////////////////////////////////////////////////////////////////////////
+
+/// visit читает общее значение и не копирует его: visitor всегда получает const&.
+/// Пустой (перемещенный) shared_variant - bad_variant_access, как std::visit для valueless_by_exception
+
+template <class Visitor, class Count, class... Ts>
+decltype(auto) visit(Visitor&& vis, basic_shared_variant<Count, Ts...> const& v) {
+    if (v.valueless_by_exception()) details::throw_bad_variant_access();
+    return vr::visit(std::forward<Visitor>(vis), v.value());
+}
+
+template <class Visitor, class Count, class... Ts>
+decltype(auto) visit(Visitor&& vis, basic_shared_variant<Count, Ts...>& v) {
+    if (v.valueless_by_exception()) details::throw_bad_variant_access();
+    return vr::visit(std::forward<Visitor>(vis), v.value());
+}
+
+template <class Visitor, class Count, class... Ts>
+decltype(auto) visit(Visitor&& vis, basic_shared_variant<Count, Ts...>&& v) {
+    if (v.valueless_by_exception()) details::throw_bad_variant_access();
+    return vr::visit(std::forward<Visitor>(vis), v.value());
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+template <typename T, typename Count, typename... Ts>
+bool holds_alternative(basic_shared_variant<Count, Ts...> const& v) noexcept {
+    return details::alternative_index_v<T, Ts...> == v.index();
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+template <std::size_t I, class Count, class... Types>
+decltype(auto) get(basic_shared_variant<Count, Types...> const& v) {
+    if (v.index() != I) details::throw_bad_variant_access();
+    return get<I>(v.value());
+}
+
+/// Изменяемая ссылка: значение отделяется от остальных владельцев (только если индекс верный)
+template <std::size_t I, class Count, class... Types>
+decltype(auto) get(basic_shared_variant<Count, Types...>& v) {
+    if (v.index() != I) details::throw_bad_variant_access();
+    return get<I>(v.mutate());
+}
+
+template <class T, class Count, class... Types, std::size_t I = details::alternative_index_v<T, Types...>>
+T const& get(basic_shared_variant<Count, Types...> const& v) {
+    return get<I>(v);
+}
+
+template <class T, class Count, class... Types, std::size_t I = details::alternative_index_v<T, Types...>>
+T& get(basic_shared_variant<Count, Types...>& v) {
+    return get<I>(v);
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+template <std::size_t I, class Count, class... Types>
+auto get_if(basic_shared_variant<Count, Types...> const* pv) noexcept {
+    return pv && pv->index() == I ? get_if<I>(&pv->value()) : nullptr;
+}
+
+template <std::size_t I, class Count, class... Types>
+auto get_if(basic_shared_variant<Count, Types...>* pv) {
+    return pv && pv->index() == I ? get_if<I>(&pv->mutate()) : nullptr;
+}
+
+template <class T, class Count, class... Types>
+auto get_if(basic_shared_variant<Count, Types...> const* pv) noexcept {
+    return get_if<details::alternative_index_v<T, Types...>>(pv);
+}
+
+template <class T, class Count, class... Types>
+auto get_if(basic_shared_variant<Count, Types...>* pv) {
+    return get_if<details::alternative_index_v<T, Types...>>(pv);
+}
+
+//////////////////////////////////////////////////////////////
+
+template <class Count, class... Types>
+void swap(basic_shared_variant<Count, Types...>& lhs, basic_shared_variant<Count, Types...>& rhs) noexcept {
+    lhs.swap(rhs);
+}
+
+/////////////////////////////////////////////////////// END Non-member functions //////////////////////////////////////////////////////////////////////////
+
+} // end vr
+
+#endif // SHARED_VARIANT_H
@@ -0,0 +1,353 @@
+#ifndef STRICT_VARIANT_H
+#define STRICT_VARIANT_H
+
+#include "variant.h"
+
+namespace vr {
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// strict_variant<Ts...> - variant, который никогда не бывает valueless_by_exception.
+/// Хранилище то же (storage_t), но все изменения идут через emplace, который выбирает способ
+/// для каждой альтернативы на этапе компиляции:
+///   1) T конструируется из аргументов без исключений - прямо на месте старого значения;
+///   2) T перемещается без исключений - сначала временный T, потом уничтожение старого и перемещение;
+///   3) иначе при исключении на место значения ставится запасная альтернатива - первая из Ts,
+///      конструируемая по умолчанию без исключений (например monostate); если такой нет - ошибка компиляции.
+///
+/// Поэтому index() - это просто индекс без проверки на variant_npos, а visit и get не ветвятся на пустоту.
+///
+
+template<typename... Ts>
+struct strict_variant;
+
+template<typename... Ts>
+struct variant_size<strict_variant<Ts...>> : std::integral_constant<std::size_t, sizeof...(Ts)> {};
+
+template<std::size_t I, typename... Ts>
+struct variant_alternative<I, strict_variant<Ts...>> {
+    using type = details::get_type_at_t<I, Ts...>;
+};
+
+template<typename... Ts>
+struct is_trivially_relocatable<strict_variant<Ts...>> : std::bool_constant<(is_trivially_relocatable_v<Ts> && ...)> {};
+
+namespace details {
+
+    namespace strict {
+
+        /// Индекс запасной альтернативы или sizeof...(Ts), если ее нет
+        template<typename... Ts>
+        constexpr std::size_t fallback_index() {
+            constexpr bool nothrow_default[] = {std::is_nothrow_default_constructible_v<Ts>...};
+            for (std::size_t i = 0; i < sizeof...(Ts); ++i) {
+                if (nothrow_default[i]) return i;
+            }
+            return sizeof...(Ts);
+        }
+
+        /// Присваивание хранилищ storage_t оставляет значение на месте, если все альтернативы перемещаются без исключений
+        template<typename... Ts>
+        inline constexpr bool storage_assignment_is_strict_v = (std::is_nothrow_move_constructible_v<Ts> && ...);
+
+    } // end strict
+
+} // details end
+
+template<typename... Ts>
+struct strict_variant {
+
+    static_assert(0 < sizeof...(Ts), "strict_variant must have at least one alternative");
+
+    constexpr static std::size_t fallback_index = details::strict::fallback_index<Ts...>();
+
+//////////////////////////// Constructors ///////////////////////////////////
+
+    template<std::enable_if_t<std::is_default_constructible_v<details::get_type_at_t<0, Ts...>>>* = nullptr>
+    constexpr strict_variant() noexcept(std::is_nothrow_default_constructible_v<details::get_type_at_t<0, Ts...>>)
+        : storage(std::in_place_index_t<0>{}) {}
+
+    /// Исключение в конструкторе копирования не оставляет объекта вовсе, так что пустым он не бывает
+    constexpr strict_variant(strict_variant const&) = default;
+    constexpr strict_variant(strict_variant&&) = default;
+
+    template <typename T,
+              typename D = std::decay_t<T>,
+              std::enable_if_t<!std::is_same_v<D, strict_variant> && !details::is_in_place_v<D> &&
+                               !details::is_in_place_index_v<D> && !details::is_in_place_type_v<D>>* = nullptr,
+              std::size_t I = details::find_best_match_v<T, Ts...>,
+              typename M = details::get_type_at_t<I, Ts...>,
+              std::enable_if_t<std::is_constructible_v<M, T>>* = nullptr>
+    constexpr strict_variant(T&& arg) noexcept(std::is_nothrow_constructible_v<M, T>)
+        : storage(std::in_place_index<I>, std::forward<T>(arg)) {}
+
+    template <typename T, typename... As,
+              std::size_t I = details::alternative_index_v<T, Ts...>,
+              std::enable_if_t<std::is_constructible_v<T, As...>>* = nullptr>
+    constexpr explicit strict_variant(std::in_place_type_t<T>, As&&... args) noexcept(std::is_nothrow_constructible_v<T, As...>)
+        : storage(std::in_place_index<I>, std::forward<As>(args)...) {}
+
+    template <std::size_t I, typename... As,
+              typename T = details::get_type_at_t<I, Ts...>,
+              std::enable_if_t<std::is_constructible_v<T, As...>>* = nullptr>
+    constexpr explicit strict_variant(std::in_place_index_t<I>, As&&... args) noexcept(std::is_nothrow_constructible_v<T, As...>)
+        : storage(std::in_place_index<I>, std::forward<As>(args)...) {}
+
+//////////////////////////// Assignment ///////////////////////////////////
+
+    strict_variant& operator =(strict_variant const& rhs) {
+        if constexpr (details::strict::storage_assignment_is_strict_v<Ts...>) {
+            storage = rhs.storage;
+        } else {
+            assign_from(rhs);
+        }
+        return *this;
+    }
+
+    strict_variant& operator =(strict_variant&& rhs) noexcept(((std::is_nothrow_move_constructible_v<Ts> &&
+                                                                std::is_nothrow_move_assignable_v<Ts>) && ...)) {
+        if constexpr (details::strict::storage_assignment_is_strict_v<Ts...>) {
+            storage = std::move(rhs.storage);
+        } else {
+            assign_from(std::move(rhs));
+        }
+        return *this;
+    }
+
+    template <typename A,
+              std::enable_if_t<!std::is_same_v<std::decay_t<A>, strict_variant>>* = nullptr,
+              std::size_t I = details::find_best_match_v<A, Ts...>,
+              typename T = details::get_type_at_t<I, Ts...>,
+              std::enable_if_t<(std::is_assignable_v<T&, A> && std::is_constructible_v<T, A>)>* = nullptr>
+    strict_variant& operator =(A&& arg) {
+        if (index() == I) {
+            details::access::variant_helper::get_alternative<I>(*this).value = std::forward<A>(arg);
+        } else {
+            emplace<I>(std::forward<A>(arg));
+        }
+        return *this;
+    }
+
+//////////////////////////// Modifiers ///////////////////////////////////
+
+    template <std::size_t I, typename... As, typename T = details::get_type_at_t<I, Ts...>,
+              std::enable_if_t<std::is_constructible_v<T, As...>>* = nullptr>
+    T& emplace(As&&... args) {
+        if constexpr (std::is_nothrow_constructible_v<T, As...>) {
+            destroy_active();
+            return construct<I>(std::forward<As>(args)...);
+        } else if constexpr (std::is_nothrow_move_constructible_v<T>) {
+            T value(std::forward<As>(args)...);
+            destroy_active();
+            return construct<I>(std::move(value));
+        } else {
+            static_assert(fallback_index < sizeof...(Ts),
+                          "strict_variant needs a nothrow default constructible alternative (e.g. monostate) "
+                          "to fall back to when an alternative can throw on both construction and move");
+            destroy_active();
+            VR_TRY {
+                return construct<I>(std::forward<As>(args)...);
+            } VR_CATCH_ALL {
+                construct<fallback_index>();
+                VR_RETHROW;
+            }
+        }
+    }
+
+    template <typename T, typename... As, std::size_t I = details::alternative_index_v<T, Ts...>>
+    T& emplace(As&&... args) {
+        return details::unbox(emplace<I>(std::forward<As>(args)...));
+    }
+
+    void swap(strict_variant& rhs) noexcept((is_trivially_relocatable_v<Ts> && ...) ||
+                                            ((std::is_nothrow_move_constructible_v<Ts> &&
+                                              std::is_nothrow_swappable_v<Ts>) && ...)) {
+        if constexpr ((is_trivially_relocatable_v<Ts> && ...) || details::strict::storage_assignment_is_strict_v<Ts...>) {
+            storage.swap(rhs.storage);
+        } else {
+            strict_variant tmp(std::move(rhs));
+            rhs = std::move(*this);
+            *this = std::move(tmp);
+        }
+    }
+
+//////////////////////////// Observers ///////////////////////////////////
+
+    constexpr std::size_t index() const noexcept {
+        return storage.indx;
+    }
+
+    constexpr bool valueless_by_exception() const noexcept {
+        return false;
+    }
+
+    constexpr static std::size_t size() {
+        return sizeof...(Ts);
+    }
+
+    /// visit одного варианта: индекс идет в диспетчер как есть, без проверки на variant_npos
+    template<visit_strategy S = visit_strategy::inline_switch, typename Visitor>
+    decltype(auto) visit(Visitor&& visitor) & {
+        return visit_self<S>(std::forward<Visitor>(visitor), *this);
+    }
+
+    template<visit_strategy S = visit_strategy::inline_switch, typename Visitor>
+    decltype(auto) visit(Visitor&& visitor) const& {
+        return visit_self<S>(std::forward<Visitor>(visitor), *this);
+    }
+
+    template<visit_strategy S = visit_strategy::inline_switch, typename Visitor>
+    decltype(auto) visit(Visitor&& visitor) && {
+        return visit_self<S>(std::forward<Visitor>(visitor), std::move(*this));
+    }
+
+    friend struct details::access::variant_helper;
+    friend struct details::visitor::variant_helper;
+
+private:
+
+    template<visit_strategy S, typename Visitor, typename Self>
+    static decltype(auto) visit_self(Visitor&& visitor, Self&& self) {
+        return details::visitor::dispatch_index<sizeof...(Ts), S>(self.index(), [&](auto I) -> decltype(auto) {
+            return std::invoke(std::forward<Visitor>(visitor),
+                               details::access::variant_helper::get_value<decltype(I)::value>(std::forward<Self>(self)));
+        });
+    }
+
+    /// Уничтожает активную альтернативу, не трогая индекс: следующим шагом на ее место всегда что-то конструируется
+    void destroy_active() noexcept {
+        using ops = details::storage::operations<Ts...>;
+        if constexpr (!(std::is_trivially_destructible_v<Ts> && ...)) {
+            if (!ops::trivially_destructible[storage.indx]) {
+                ops::table[storage.indx].destroy(std::addressof(storage.data));
+            }
+        }
+    }
+
+    template<std::size_t I, typename... As>
+    details::get_type_at_t<I, Ts...>& construct(As&&... args) {
+        auto& value = storage.construct_alternative(details::access::storage_base_helper::get_alternative<I>(storage), std::forward<As>(args)...);
+        storage.indx = I;
+        return value;
+    }
+
+    /// Поэлементное присваивание через emplace: используется, когда присваивание storage_t могло бы оставить его пустым
+    template<typename V>
+    void assign_from(V&& rhs) {
+        details::visitor::dispatch_index<sizeof...(Ts)>(rhs.index(), [&](auto I) {
+            constexpr std::size_t i = decltype(I)::value;
+            auto&& value = details::access::variant_helper::get_alternative<i>(std::forward<V>(rhs)).value;
+            if (index() == i) {
+                details::access::variant_helper::get_alternative<i>(*this).value = std::forward<decltype(value)>(value);
+            } else {
+                emplace<i>(std::forward<decltype(value)>(value));
+            }
+        });
+    }
+
+    details::storage::storage_t<Ts...> storage;
+};
+
+/////////////////////////////////////////////////////// Non-member functions //////////////////////////////////////////////////////////////////////////
+
+template <class Visitor, class... Ts>
+decltype(auto) visit(Visitor&& vis, strict_variant<Ts...>& v) {
+    return v.visit(std::forward<Visitor>(vis));
+}
+
+template <class Visitor, class... Ts>
+decltype(auto) visit(Visitor&& vis, strict_variant<Ts...> const& v) {
+    return v.visit(std::forward<Visitor>(vis));
+}
+
+template <class Visitor, class... Ts>
+decltype(auto) visit(Visitor&& vis, strict_variant<Ts...>&& v) {
+    return std::move(v).visit(std::forward<Visitor>(vis));
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+template <typename T, typename... Ts>
+constexpr bool holds_alternative(strict_variant<Ts...> const& v) noexcept {
+    return details::alternative_index_v<T, Ts...> == v.index();
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+template <std::size_t I, class... Types>
+constexpr details::unboxed_t<variant_alternative_t<I, strict_variant<Types...>>>& get(strict_variant<Types...>& v) {
+    if (v.index() == I)
+        return details::access::variant_helper::get_value<I>(v);
+    else
+        details::throw_bad_variant_access();
+}
+
+template <std::size_t I, class... Types>
+constexpr details::unboxed_t<variant_alternative_t<I, strict_variant<Types...>>> const& get(strict_variant<Types...> const& v) {
+    if (v.index() == I)
+        return details::access::variant_helper::get_value<I>(v);
+    else
+        details::throw_bad_variant_access();
+}
+
+template <std::size_t I, class... Types>
+constexpr details::unboxed_t<variant_alternative_t<I, strict_variant<Types...>>>&& get(strict_variant<Types...>&& v) {
+    if (v.index() == I)
+        return details::access::variant_helper::get_value<I>(std::move(v));
+    else
+        details::throw_bad_variant_access();
+}
+
+template <class T, class... Types, std::size_t I = details::alternative_index_v<T, Types...>>
+constexpr T& get(strict_variant<Types...>& v) {
+    return get<I>(v);
+}
+
+template <class T, class... Types, std::size_t I = details::alternative_index_v<T, Types...>>
+constexpr const T& get(strict_variant<Types...> const& v) {
+    return get<I>(v);
+}
+
+template <class T, class... Types, std::size_t I = details::alternative_index_v<T, Types...>>
+constexpr T&& get(strict_variant<Types...>&& v) {
+    return get<I>(std::move(v));
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+template <std::size_t I, class... Types>
+constexpr std::add_pointer_t<details::unboxed_t<variant_alternative_t<I, strict_variant<Types...>>>> get_if(strict_variant<Types...>* pv) noexcept {
+    if (pv && pv->index() == I)
+        return &details::access::variant_helper::get_value<I>(*pv);
+    return nullptr;
+}
+
+template <std::size_t I, class... Types>
+constexpr std::add_pointer_t<const details::unboxed_t<variant_alternative_t<I, strict_variant<Types...>>>> get_if(const strict_variant<Types...>* pv) noexcept {
+    if (pv && pv->index() == I)
+        return &details::access::variant_helper::get_value<I>(*pv);
+    return nullptr;
+}
+
+template <class T, class... Types>
+constexpr std::add_pointer_t<T> get_if(strict_variant<Types...>* pv) noexcept {
+    return get_if<details::alternative_index_v<T, Types...>>(pv);
+}
+
+template <class T, class... Types>
+constexpr std::add_pointer_t<const T> get_if(const strict_variant<Types...>* pv) noexcept {
+    return get_if<details::alternative_index_v<T, Types...>>(pv);
+}
+
+//////////////////////////////////////////////////////////////
+
+template <class... Types>
+void swap(strict_variant<Types...>& lhs, strict_variant<Types...>& rhs) noexcept(noexcept(lhs.swap(rhs))) {
+    lhs.swap(rhs);
+}
+
+/////////////////////////////////////////////////////// END Non-member functions //////////////////////////////////////////////////////////////////////////
+
+} // end vr
+
+#endif // STRICT_VARIANT_H
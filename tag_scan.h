@@ -0,0 +1,423 @@
+#ifndef TAG_SCAN_H
+#define TAG_SCAN_H
+
+#include "variant.h"
+#include "variant_vector.h"
+#include <atomic>
+
+/// Векторные ядра есть только для x86 в GCC/Clang: AVX2 включается атрибутом target и выбирается во время
+/// выполнения (__builtin_cpu_supports), SSE2 - если он базовый для цели сборки
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#   define VR_TAG_SCAN_X86 1
+#   include <immintrin.h>
+#else
+#   define VR_TAG_SCAN_X86 0
+#endif
+
+namespace vr {
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// Подсчет, поиск и гистограмма альтернатив по тегам без visit и без чтения значений:
+///
+///     std::vector<vr::variant<int, double, std::string>> values = ...;
+///     std::size_t strings = vr::count_alternative<std::string>(values.data(), values.size());
+///     std::vector<std::size_t> doubles = vr::find_alternative<double>(values.data(), values.size());
+///     auto histogram = vr::alternative_histogram(values.data(), values.size()); // [N] - valueless_by_exception
+///
+/// Теги читаются либо из упакованного массива (variant_vector::tags(), любой массив беззнаковых тегов -
+/// count_tag/find_tag/tag_mask), либо прямо из массива variant с шагом sizeof(variant): индекс хранится
+/// в variant_index_t<N> (обычно один байт), и за раз сравнивается блок из 64 тегов, результат - 64-битная маска.
+/// Маски (alternative_mask/tag_mask) можно комбинировать побитово и превращать в позиции mask_positions.
+///
+/// Ядра для однобайтовых и двухбайтовых тегов: упакованные - SSE2 (16 тегов за сравнение) или AVX2 (32),
+/// теги внутри вариантов - AVX2 gather (8 тегов за загрузку). Уровень выбирается один раз во время выполнения;
+/// без SSE2/AVX2, для других платформ и широких тегов работает скалярный цикл с тем же результатом. Для тегов
+/// внутри вариантов SSE2 ядра нет: без AVX2 count_alternative - тот же цикл, что и по holds_alternative.
+/// limit_tag_scan(simd_level::scalar) ограничивает уровень (сравнение путей в тестах и замерах).
+///
+
+enum class simd_level { scalar, sse2, avx2 };
+
+namespace details {
+
+    namespace scan {
+
+        inline int popcount(std::uint64_t m) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+            return __builtin_popcountll(m);
+#else
+            int count = 0;
+            for (; m; m &= m - 1) ++count;
+            return count;
+#endif
+        }
+
+        inline int lowest_bit(std::uint64_t m) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+            return __builtin_ctzll(m);
+#else
+            int i = 0;
+            for (; !(m & 1); m >>= 1) ++i;
+            return i;
+#endif
+        }
+
+        inline simd_level detect() noexcept {
+#if VR_TAG_SCAN_X86
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2")) return simd_level::avx2;
+#   if defined(__SSE2__)
+            return simd_level::sse2;
+#   endif
+#endif
+            return simd_level::scalar;
+        }
+
+        inline std::atomic<simd_level> limit{simd_level::avx2};
+
+        inline simd_level level() noexcept {
+            static simd_level const detected = detect();
+            simd_level max = limit.load(std::memory_order_relaxed);
+            return detected < max ? detected : max;
+        }
+
+        constexpr std::size_t block = 64;
+
+        /// Теги first, first + stride, ... (n штук); начиная с first можно читать readable байт
+        struct tags {
+            unsigned char const* first;
+            std::size_t n;
+            std::size_t stride;
+            std::size_t readable;
+        };
+
+        /// Маска совпадений для 64 тегов с начала p
+        using block_fn = std::uint64_t (*)(unsigned char const* p, std::size_t stride, std::uint32_t tag);
+
+        template<typename Tag>
+        Tag load(unsigned char const* p) noexcept {
+            Tag value;
+            std::memcpy(&value, p, sizeof(Tag));
+            return value;
+        }
+
+        template<typename Tag>
+        std::uint64_t match_scalar(unsigned char const* p, std::size_t stride, std::size_t count, std::uint32_t tag) noexcept {
+            std::uint64_t mask = 0;
+            for (std::size_t k = 0; k < count; ++k) {
+                mask |= std::uint64_t(load<Tag>(p + k * stride) == tag) << k;
+            }
+            return mask;
+        }
+
+        template<typename Tag>
+        std::uint64_t match_block_scalar(unsigned char const* p, std::size_t stride, std::uint32_t tag) noexcept {
+            return match_scalar<Tag>(p, stride, block, tag);
+        }
+
+#if VR_TAG_SCAN_X86
+
+#   if defined(__SSE2__)
+        inline std::uint64_t match_sse2_u8(unsigned char const* p, std::size_t, std::uint32_t tag) noexcept {
+            __m128i t = _mm_set1_epi8(static_cast<char>(tag));
+            std::uint64_t mask = 0;
+            for (int k = 0; k < 4; ++k) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + 16 * k));
+                mask |= std::uint64_t(static_cast<std::uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, t)))) << (16 * k);
+            }
+            return mask;
+        }
+
+        inline std::uint64_t match_sse2_u16(unsigned char const* p, std::size_t, std::uint32_t tag) noexcept {
+            __m128i t = _mm_set1_epi16(static_cast<short>(tag));
+            std::uint64_t mask = 0;
+            for (int k = 0; k < 4; ++k) {
+                __m128i a = _mm_cmpeq_epi16(_mm_loadu_si128(reinterpret_cast<__m128i const*>(p + 32 * k)), t);
+                __m128i b = _mm_cmpeq_epi16(_mm_loadu_si128(reinterpret_cast<__m128i const*>(p + 32 * k + 16)), t);
+                mask |= std::uint64_t(static_cast<std::uint16_t>(_mm_movemask_epi8(_mm_packs_epi16(a, b)))) << (16 * k);
+            }
+            return mask;
+        }
+#   endif
+
+        __attribute__((target("avx2")))
+        inline std::uint64_t match_avx2_u8(unsigned char const* p, std::size_t, std::uint32_t tag) noexcept {
+            __m256i t = _mm256_set1_epi8(static_cast<char>(tag));
+            __m256i lo = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(p)), t);
+            __m256i hi = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(p + 32)), t);
+            return std::uint64_t(static_cast<std::uint32_t>(_mm256_movemask_epi8(lo))) |
+                   std::uint64_t(static_cast<std::uint32_t>(_mm256_movemask_epi8(hi))) << 32;
+        }
+
+        /// packs_epi16 склеивает 128-битные половины через одну, permute возвращает порядок тегов
+        __attribute__((target("avx2")))
+        inline std::uint64_t match_avx2_u16(unsigned char const* p, std::size_t, std::uint32_t tag) noexcept {
+            __m256i t = _mm256_set1_epi16(static_cast<short>(tag));
+            std::uint64_t mask = 0;
+            for (int k = 0; k < 2; ++k) {
+                __m256i a = _mm256_cmpeq_epi16(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(p + 64 * k)), t);
+                __m256i b = _mm256_cmpeq_epi16(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(p + 64 * k + 32)), t);
+                __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(a, b), 0xD8);
+                mask |= std::uint64_t(static_cast<std::uint32_t>(_mm256_movemask_epi8(packed))) << (32 * k);
+            }
+            return mask;
+        }
+
+        /// Теги внутри вариантов: gather читает 4 байта с начала каждого тега, лишние байты отрезаются маской
+        template<typename Tag>
+        __attribute__((target("avx2")))
+        std::uint64_t match_avx2_gather(unsigned char const* p, std::size_t stride, std::uint32_t tag) noexcept {
+            __m256i offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(static_cast<int>(stride)));
+            __m256i width = _mm256_set1_epi32(static_cast<int>(std::numeric_limits<Tag>::max()));
+            __m256i t = _mm256_set1_epi32(static_cast<int>(tag));
+            std::uint64_t mask = 0;
+            for (int k = 0; k < 8; ++k) {
+                __m256i v = _mm256_i32gather_epi32(reinterpret_cast<int const*>(p + 8 * k * stride), offsets, 1);
+                __m256i eq = _mm256_cmpeq_epi32(_mm256_and_si256(v, width), t);
+                mask |= std::uint64_t(static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(eq)))) << (8 * k);
+            }
+            return mask;
+        }
+
+#endif
+
+        /// Ядро для целых блоков и сколько байт оно читает после последнего тега блока
+        struct kernel {
+            block_fn match;
+            std::size_t overread;
+        };
+
+        template<typename Tag>
+        kernel select(std::size_t stride) noexcept {
+            kernel scalar{&match_block_scalar<Tag>, 0};
+#if VR_TAG_SCAN_X86
+            if constexpr (sizeof(Tag) <= 2) {
+                simd_level l = level();
+                bool packed = stride == sizeof(Tag);
+                if (l == simd_level::avx2) {
+                    if (packed) return {sizeof(Tag) == 1 ? &match_avx2_u8 : &match_avx2_u16, 0};
+                    if (stride <= (std::size_t(1) << 24)) return {&match_avx2_gather<Tag>, 4 - sizeof(Tag)};
+                }
+#   if defined(__SSE2__)
+                if (l >= simd_level::sse2 && packed) return {sizeof(Tag) == 1 ? &match_sse2_u8 : &match_sse2_u16, 0};
+#   endif
+            }
+#endif
+            (void)stride;
+            return scalar;
+        }
+
+        /// f(i, mask) для блоков по 64 тега с начала i; в маске неполного последнего блока только его биты
+        template<typename Tag, typename F>
+        void for_each_mask(tags const& t, std::uint32_t tag, F&& f) {
+            kernel k = select<Tag>(t.stride);
+            for (std::size_t i = 0; i < t.n; i += block) {
+                unsigned char const* p = t.first + i * t.stride;
+                std::size_t count = t.n - i < block ? t.n - i : block;
+                bool whole = count == block && (i + block - 1) * t.stride + sizeof(Tag) + k.overread <= t.readable;
+                f(i, whole ? k.match(p, t.stride, tag) : match_scalar<Tag>(p, t.stride, count, tag));
+            }
+        }
+
+        template<typename Tag>
+        bool vectorized(std::size_t stride) noexcept {
+            return select<Tag>(stride).match != &match_block_scalar<Tag>;
+        }
+
+        /// Без векторного ядра count не строит маски, а сравнивают теги по одному - как цикл holds_alternative
+        template<typename Tag>
+        std::size_t count(tags const& t, std::uint32_t tag) {
+            std::size_t result = 0;
+            if (!vectorized<Tag>(t.stride)) {
+                for (std::size_t i = 0; i < t.n; ++i) result += load<Tag>(t.first + i * t.stride) == tag;
+                return result;
+            }
+            for_each_mask<Tag>(t, tag, [&](std::size_t, std::uint64_t m) { result += static_cast<std::size_t>(popcount(m)); });
+            return result;
+        }
+
+        template<typename Tag>
+        void mask(tags const& t, std::uint32_t tag, std::uint64_t* words) {
+            for_each_mask<Tag>(t, tag, [&](std::size_t i, std::uint64_t m) { words[i / block] = m; });
+        }
+
+        template<typename Tag>
+        std::vector<std::size_t> find(tags const& t, std::uint32_t tag) {
+            std::vector<std::size_t> positions;
+            for_each_mask<Tag>(t, tag, [&](std::size_t i, std::uint64_t m) {
+                for (; m; m &= m - 1) positions.push_back(i + static_cast<std::size_t>(lowest_bit(m)));
+            });
+            return positions;
+        }
+
+        /// histogram[j] - число тегов values[j]. Упакованные теги при немногих значениях сравниваются векторно
+        /// с каждым значением поблочно (блок уже в L1). Теги внутри вариантов однобайтовые считаются таблицей:
+        /// проход все равно упирается в память, а векторный путь читал бы каждый тег по разу на значение
+        template<typename Tag, std::size_t M>
+        std::array<std::size_t, M> histogram(tags const& t, std::array<std::uint32_t, M> const& values) {
+            std::array<std::size_t, M> result{};
+            kernel k = select<Tag>(t.stride);
+            if (M <= 16 && t.stride == sizeof(Tag) && vectorized<Tag>(t.stride)) {
+                for (std::size_t i = 0; i < t.n; i += block) {
+                    std::size_t count = t.n - i < block ? t.n - i : block;
+                    unsigned char const* p = t.first + i * t.stride;
+                    for (std::size_t j = 0; j < M; ++j) {
+                        std::uint64_t m = count == block ? k.match(p, t.stride, values[j]) : match_scalar<Tag>(p, t.stride, count, values[j]);
+                        result[j] += static_cast<std::size_t>(popcount(m));
+                    }
+                }
+            } else if constexpr (sizeof(Tag) == 1) {
+                std::array<std::size_t, 256> counts{};
+                for (std::size_t i = 0; i < t.n; ++i) ++counts[t.first[i * t.stride]];
+                for (std::size_t j = 0; j < M; ++j) result[j] = counts[values[j]];
+            } else {
+                for (std::size_t i = 0; i < t.n; ++i) {
+                    Tag value = load<Tag>(t.first + i * t.stride);
+                    for (std::size_t j = 0; j < M; ++j) result[j] += value == values[j];
+                }
+            }
+            return result;
+        }
+
+        template<typename Tag>
+        tags packed(Tag const* first, std::size_t n) noexcept {
+            return {reinterpret_cast<unsigned char const*>(first), n, sizeof(Tag), n * sizeof(Tag)};
+        }
+
+        template<typename V>
+        tags strided(V const* values, std::size_t n) noexcept {
+            if (n == 0) return {nullptr, 0, sizeof(V), 0};
+            std::size_t offset = access::variant_helper::index_offset(values[0]);
+            return {reinterpret_cast<unsigned char const*>(values) + offset, n, sizeof(V), n * sizeof(V) - offset};
+        }
+
+        template<typename... Ts>
+        using tag_t = variant_index_t<sizeof...(Ts)>;
+
+        /// Значения тегов гистограммы: 0..N-1 и тег valueless_by_exception
+        template<typename Tag, std::size_t... Is>
+        constexpr std::array<std::uint32_t, sizeof...(Is) + 1> histogram_tags(std::index_sequence<Is...>) {
+            return {static_cast<std::uint32_t>(Is)..., static_cast<std::uint32_t>(std::numeric_limits<Tag>::max())};
+        }
+
+    } // end scan
+
+} // details end
+
+/// Уровень векторных ядер, которым сейчас идут все функции этого файла
+inline simd_level tag_scan_level() noexcept {
+    return details::scan::level();
+}
+
+/// Не использовать ядра выше max (по умолчанию - лучшее доступное)
+inline void limit_tag_scan(simd_level max) noexcept {
+    details::scan::limit.store(max, std::memory_order_relaxed);
+}
+
+/////////////////////////////////////////////////////// Packed tags //////////////////////////////////////////////////////////////////////////
+
+template <class Tag>
+std::size_t count_tag(Tag const* tags, std::size_t n, std::size_t index) {
+    static_assert(std::is_unsigned_v<Tag>, "tags must be unsigned integers");
+    return details::scan::count<Tag>(details::scan::packed(tags, n), static_cast<std::uint32_t>(index));
+}
+
+template <class Tag>
+std::vector<std::size_t> find_tag(Tag const* tags, std::size_t n, std::size_t index) {
+    static_assert(std::is_unsigned_v<Tag>, "tags must be unsigned integers");
+    return details::scan::find<Tag>(details::scan::packed(tags, n), static_cast<std::uint32_t>(index));
+}
+
+/// words[i / 64] бит i % 64: tags[i] == index; words - (n + 63) / 64 слов
+template <class Tag>
+void tag_mask(Tag const* tags, std::size_t n, std::size_t index, std::uint64_t* words) {
+    static_assert(std::is_unsigned_v<Tag>, "tags must be unsigned integers");
+    details::scan::mask<Tag>(details::scan::packed(tags, n), static_cast<std::uint32_t>(index), words);
+}
+
+/////////////////////////////////////////////////////// Variant arrays //////////////////////////////////////////////////////////////////////////
+
+template <class T, class... Ts>
+std::size_t count_alternative(variant<Ts...> const* values, std::size_t n) {
+    using tag_t = details::scan::tag_t<Ts...>;
+    return details::scan::count<tag_t>(details::scan::strided(values, n), details::alternative_index_v<T, Ts...>);
+}
+
+/// Позиции values с альтернативой T по возрастанию
+template <class T, class... Ts>
+std::vector<std::size_t> find_alternative(variant<Ts...> const* values, std::size_t n) {
+    using tag_t = details::scan::tag_t<Ts...>;
+    return details::scan::find<tag_t>(details::scan::strided(values, n), details::alternative_index_v<T, Ts...>);
+}
+
+/// words[i / 64] бит i % 64: holds_alternative<T>(values[i]); words - (n + 63) / 64 слов
+template <class T, class... Ts>
+void alternative_mask(variant<Ts...> const* values, std::size_t n, std::uint64_t* words) {
+    using tag_t = details::scan::tag_t<Ts...>;
+    details::scan::mask<tag_t>(details::scan::strided(values, n), details::alternative_index_v<T, Ts...>, words);
+}
+
+/// result[i] - число values с индексом i, result[N] - valueless_by_exception
+template <class... Ts>
+std::array<std::size_t, sizeof...(Ts) + 1> alternative_histogram(variant<Ts...> const* values, std::size_t n) {
+    using tag_t = details::scan::tag_t<Ts...>;
+    return details::scan::histogram<tag_t>(details::scan::strided(values, n),
+                                           details::scan::histogram_tags<tag_t>(std::index_sequence_for<Ts...>()));
+}
+
+/////////////////////////////////////////////////////// variant_vector //////////////////////////////////////////////////////////////////////////
+
+template <class T, class... Ts>
+std::size_t count_alternative(variant_vector<Ts...> const& values) noexcept {
+    return values.template count<T>();
+}
+
+template <class T, class... Ts>
+std::vector<std::size_t> find_alternative(variant_vector<Ts...> const& values) {
+    return find_tag(values.tags().data(), values.size(), details::alternative_index_v<T, Ts...>);
+}
+
+template <class T, class... Ts>
+void alternative_mask(variant_vector<Ts...> const& values, std::uint64_t* words) {
+    tag_mask(values.tags().data(), values.size(), details::alternative_index_v<T, Ts...>, words);
+}
+
+/// Число значений каждой альтернативы; result[N] == 0 (valueless значений в variant_vector нет)
+template <class... Ts>
+std::array<std::size_t, sizeof...(Ts) + 1> alternative_histogram(variant_vector<Ts...> const& values) {
+    using tag_t = typename variant_vector<Ts...>::tag_type;
+    return details::scan::histogram<tag_t>(details::scan::packed(values.tags().data(), values.size()),
+                                           details::scan::histogram_tags<tag_t>(std::index_sequence_for<Ts...>()));
+}
+
+/////////////////////////////////////////////////////// Masks //////////////////////////////////////////////////////////////////////////
+
+/// Позиции установленных битов маски из n бит (компактизация): out должен вмещать их все, возвращает их число
+inline std::size_t mask_positions(std::uint64_t const* words, std::size_t n, std::size_t* out) noexcept {
+    std::size_t count = 0;
+    for (std::size_t w = 0; w * details::scan::block < n; ++w) {
+        std::uint64_t m = words[w];
+        std::size_t bits = n - w * details::scan::block;
+        if (bits < details::scan::block) m &= (std::uint64_t(1) << bits) - 1;
+        for (; m; m &= m - 1) out[count++] = w * details::scan::block + static_cast<std::size_t>(details::scan::lowest_bit(m));
+    }
+    return count;
+}
+
+inline std::size_t mask_count(std::uint64_t const* words, std::size_t n) noexcept {
+    std::size_t count = 0;
+    for (std::size_t w = 0; w * details::scan::block < n; ++w) {
+        std::uint64_t m = words[w];
+        std::size_t bits = n - w * details::scan::block;
+        if (bits < details::scan::block) m &= (std::uint64_t(1) << bits) - 1;
+        count += static_cast<std::size_t>(details::scan::popcount(m));
+    }
+    return count;
+}
+
+/////////////////////////////////////////////////////// END //////////////////////////////////////////////////////////////////////////
+
+} // end vr
+
+#endif // TAG_SCAN_H
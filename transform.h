@@ -0,0 +1,175 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include "variant.h"
+#include <tuple>
+
+namespace vr {
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// transform(v, f) - variant из результатов f для каждой альтернативы v (одинаковые типы результатов
+/// склеиваются в одну альтернативу, порядок - по первому появлению):
+///
+///     vr::variant<int, long, std::string> v = ...;
+///     auto n = vr::transform(v, length);   // vr::variant<std::size_t> или vr::variant<int, std::size_t> и т.д.
+///
+/// Цепочка v | vr::map(f) | vr::map(g) ничего не вычисляет, пока ее не превратят в variant (неявным
+/// преобразованием или collect()) или не передадут в visit: тогда для активной альтернативы T вызывается
+/// g(f(T)) - одна диспетчеризация на всю цепочку и никаких промежуточных вариантов, а visit(h, v | map(f))
+/// не строит и итоговый вариант. Промежуточные результаты живут до конца этого вызова.
+///
+/// Цепочка хранит ссылку на lvalue v (rvalue перемещается внутрь), поэтому ее используют в том же выражении.
+/// Результаты функций хранятся по значению (std::decay_t), void результат не допускается.
+///
+
+namespace details {
+
+    namespace transform {
+
+        template<typename... Ts>
+        struct type_list {};
+
+        /// Типы без повторов в порядке первого появления
+        template<typename Unique, typename... Ts>
+        struct unique {
+            using type = Unique;
+        };
+
+        template<typename... Us, typename T, typename... Ts>
+        struct unique<type_list<Us...>, T, Ts...>
+            : std::conditional_t<(std::is_same_v<T, Us> || ...), unique<type_list<Us...>, Ts...>, unique<type_list<Us..., T>, Ts...>> {};
+
+        template<typename L>
+        struct to_variant;
+
+        template<typename... Ts>
+        struct to_variant<type_list<Ts...>> {
+            using type = variant<Ts...>;
+        };
+
+        template<typename T, typename L>
+        struct index_in;
+
+        template<typename T, typename... Ts>
+        struct index_in<T, type_list<Ts...>> : get_id_at<T, Ts...> {};
+
+        /// Применяет функции fs, начиная с K, к a, и отдает последний результат sink: все промежуточные
+        /// временные объекты еще живы, когда его получает sink
+        template<std::size_t K, typename Fs, typename Sink, typename A>
+        constexpr decltype(auto) run(Fs& fs, Sink&& sink, A&& a) {
+            if constexpr (K == std::tuple_size_v<Fs>) {
+                return std::forward<Sink>(sink)(std::forward<A>(a));
+            } else {
+                static_assert(!std::is_void_v<std::invoke_result_t<std::tuple_element_t<K, Fs>&, A&&>>, "map function must return a value");
+                return run<K + 1>(fs, std::forward<Sink>(sink), std::invoke(std::get<K>(fs), std::forward<A>(a)));
+            }
+        }
+
+        struct forward_sink {
+            template<typename A>
+            constexpr A&& operator ()(A&& a) const noexcept { return std::forward<A>(a); }
+        };
+
+        template<typename F>
+        struct map_t {
+            F f;
+        };
+
+        template<typename V, typename... Fs>
+        class chain {
+
+            using source_t = std::remove_reference_t<V>;
+            using functions_t = std::tuple<Fs...>;
+
+            template<std::size_t I>
+            using stage_result_t = std::decay_t<decltype(run<0>(std::declval<functions_t&>(), forward_sink(),
+                                                                 access::variant_helper::get_value<I>(std::declval<V&&>())))>;
+
+            template<typename Is>
+            struct result_of;
+
+            template<std::size_t... Is>
+            struct result_of<std::index_sequence<Is...>> {
+                using type = typename unique<type_list<>, stage_result_t<Is>...>::type;
+            };
+
+            using results_t = typename result_of<std::make_index_sequence<source_t::size()>>::type;
+
+        public:
+
+            using result_type = typename to_variant<results_t>::type;
+
+            constexpr chain(V&& v, functions_t&& fs) : source(std::forward<V>(v)), functions(std::move(fs)) {}
+
+            template<typename G>
+            constexpr chain<V, Fs..., G> operator |(map_t<G> next) && {
+                return chain<V, Fs..., G>(std::forward<V>(source),
+                                          std::tuple_cat(std::move(functions), std::tuple<G>(std::move(next.f))));
+            }
+
+            /// Одна диспетчеризация по активной альтернативе источника, sink получает результат всей цепочки
+            template<typename Sink>
+            constexpr decltype(auto) run_into(Sink&& sink) && {
+                if (source.valueless_by_exception()) throw_bad_variant_access();
+                return visitor::dispatch_index<source_t::size()>(source.index(), [&](auto I) -> decltype(auto) {
+                    return run<0>(functions, std::forward<Sink>(sink), access::variant_helper::get_value<decltype(I)::value>(std::forward<V>(source)));
+                });
+            }
+
+            constexpr result_type collect() && {
+                return std::move(*this).run_into([](auto&& r) {
+                    constexpr std::size_t J = index_in<std::decay_t<decltype(r)>, results_t>::value;
+                    return result_type(std::in_place_index<J>, std::forward<decltype(r)>(r));
+                });
+            }
+
+            constexpr operator result_type() && {
+                return std::move(*this).collect();
+            }
+
+        private:
+
+            V source;
+            functions_t functions;
+        };
+
+        template<typename T>
+        inline constexpr bool is_variant_v = false;
+
+        template<typename... Ts>
+        inline constexpr bool is_variant_v<variant<Ts...>> = true;
+
+    } // end transform
+
+} // details end
+
+/// Шаг цепочки v | map(f) | map(g)
+template <class F>
+constexpr details::transform::map_t<std::decay_t<F>> map(F&& f) {
+    return {std::forward<F>(f)};
+}
+
+template <class V, class F, std::enable_if_t<details::transform::is_variant_v<std::decay_t<V>>>* = nullptr>
+constexpr details::transform::chain<V, F> operator |(V&& v, details::transform::map_t<F> m) {
+    return details::transform::chain<V, F>(std::forward<V>(v), std::tuple<F>(std::move(m.f)));
+}
+
+/////////////////////////////////////////////////////// Non-member functions //////////////////////////////////////////////////////////////////////////
+
+template <class Variant, class F, std::enable_if_t<details::transform::is_variant_v<std::decay_t<Variant>>>* = nullptr>
+constexpr decltype(auto) transform(Variant&& var, F&& f) {
+    return (std::forward<Variant>(var) | map(std::forward<F>(f))).collect();
+}
+
+/// visit результата цепочки без построения варианта результатов
+template <class Visitor, class V, class... Fs>
+constexpr decltype(auto) visit(Visitor&& vis, details::transform::chain<V, Fs...>&& c) {
+    return std::move(c).run_into(std::forward<Visitor>(vis));
+}
+
+/////////////////////////////////////////////////////// END Non-member functions //////////////////////////////////////////////////////////////////////////
+
+} // end vr
+
+#endif // TRANSFORM_H
@@ -190,6 +190,21 @@ TEST(Assignment, move_literal) {
 //    std::cout << test15<< std::endl;   // ans = 010
 }
 
+TEST(Assignment, self) {
+    vr::variant<int, std::string> a(1);
+    vr::variant<int, std::string> b(std::string("text"));
+    auto& ra = a;
+    auto& rb = b;
+    a = ra;
+    b = rb;
+    a = std::move(ra);
+    vr::strict_variant<int, std::string> s(2);
+    auto& rs = s;
+    s = rs;
+    std::string test54 = std::to_string(vr::get<int>(a)) + vr::get<std::string>(b) + std::to_string(vr::get<int>(s));
+    EXPECT_EQ(test54, "1text2");
+}
+
 TEST(Holds_alternative, type) {
     std::string test16;
     vr::variant<COMPLEX_TYPES> t;
@@ -307,4 +322,864 @@ TEST(Emplace, trivial) {
 //    std::cout << test25 << std::endl;
 }
 
+template<typename... Ts>
+constexpr std::size_t compact_variant_size() {
+    constexpr std::size_t size = std::max({sizeof(Ts)...}) + sizeof(unsigned char);
+    constexpr std::size_t align = std::max({alignof(Ts)...});
+    return (size + align - 1) / align * align;
+}
+
+struct tag_a {};
+struct tag_b {};
+
+TEST(Layout, compact_index) {
+    static_assert(std::is_same_v<vr::details::variant_index_t<2>, unsigned char>);
+    static_assert(std::is_same_v<vr::details::variant_index_t<255>, unsigned char>);
+    static_assert(std::is_same_v<vr::details::variant_index_t<256>, unsigned short>);
+
+    static_assert(sizeof(vr::variant<int, float>) == 8);
+    static_assert(sizeof(vr::variant<COMPLEX_TYPES_WITH_USER_DEFINED>) == compact_variant_size<COMPLEX_TYPES_WITH_USER_DEFINED>());
+    static_assert(sizeof(vr::variant<COMPLEX_TYPES>) == compact_variant_size<COMPLEX_TYPES>());
+    static_assert(sizeof(vr::variant<CONSTEXPR_TYPES>) == compact_variant_size<CONSTEXPR_TYPES>());
+    static_assert(sizeof(vr::variant<CONSTEXPR_TYPES_WITH_USER_DEFINED>) == compact_variant_size<CONSTEXPR_TYPES_WITH_USER_DEFINED>());
+#if VR_HAS_NO_UNIQUE_ADDRESS
+    static_assert(sizeof(vr::variant<vr::monostate, tag_a, tag_b>) == sizeof(unsigned char));
+#endif
+
+    std::string test26;
+    vr::variant<vr::monostate, tag_a, tag_b> t;
+    test26 += std::to_string(t.index());
+    t = tag_b{};
+    test26 += std::to_string(t.index());
+    vr::variant<vr::monostate, tag_a, tag_b> tt(t);
+    tt.emplace<tag_a>();
+    test26 += std::to_string(tt.index()) + std::to_string(vr::holds_alternative<tag_b>(t));
+    EXPECT_EQ(test26, "0211");
+}
+
+struct node_a { int x; };
+struct node_b { double y; };
+struct node_c { std::string z; };
+
+TEST(Ptr_variant, visit_get) {
+    static_assert(sizeof(vr::ptr_variant<node_a*, node_b*, node_c*>) == sizeof(void*));
+
+    std::string test27;
+    node_a a{1};
+    node_b b{2.5};
+    node_c c{"three"};
+    vr::ptr_variant<node_a*, node_b*, node_c*> p(&b);
+    auto print = [&test27](auto* node) {
+        using type = std::remove_pointer_t<decltype(node)>;
+        if constexpr (std::is_same_v<type, node_a>) test27 += std::to_string(node->x);
+        else if constexpr (std::is_same_v<type, node_b>) test27 += std::to_string(node->y);
+        else test27 += node->z;
+        test27 += " ";
+    };
+    vr::visit(print, p);
+    p = &c;
+    vr::visit(print, p);
+    p.emplace<node_a*>(&a);
+    vr::visit(print, std::as_const(p));
+    test27 += std::to_string(p.index()) + std::to_string(vr::holds_alternative<node_a*>(p));
+    test27 += std::to_string(vr::get<node_a*>(p) == &a) + std::to_string(vr::get_if<node_c*>(&p) == nullptr);
+    try {
+        vr::get<1>(p);
+    } catch (vr::bad_variant_access&) {
+        test27 += "BAD";
+    }
+    EXPECT_EQ(test27, "2.500000 three 1 0111BAD");
+}
+
+struct script_object { int id; };
+
+TEST(Nanbox_variant, round_trip) {
+    using value = vr::nanbox_variant<double, int32_t, bool, vr::monostate, script_object*>;
+    static_assert(sizeof(value) == sizeof(std::uint64_t));
+
+    std::string test28;
+    script_object obj{7};
+    std::vector<value> values{1.5, int32_t(-3), true, vr::monostate{}, &obj, std::nan(""), -0.0};
+    for (value const& v : values) {
+        test28 += std::to_string(v.index());
+    }
+    test28 += " ";
+    vr::visit([&test28](auto a) {
+        using type = decltype(a);
+        if constexpr (std::is_same_v<type, int32_t>) test28 += std::to_string(a);
+        else if constexpr (std::is_same_v<type, script_object*>) test28 += std::to_string(a->id);
+    }, values[1]);
+    test28 += std::to_string(vr::get<script_object*>(values[4])->id) + std::to_string(vr::get<bool>(values[2]));
+    test28 += std::to_string(vr::get_if<double>(&values[0]).value_or(0)) + std::to_string(vr::get_if<double>(&values[1]).has_value());
+    test28 += std::to_string(values[6] == value(0.0)) + std::to_string(values[5] == values[5]);
+    EXPECT_EQ(test28, "0123400 -3711.500000010");
+}
+
+template<typename Is>
+struct wide_variant;
+
+template<std::size_t... Is>
+struct wide_variant<std::index_sequence<Is...>> {
+    using type = vr::variant<std::integral_constant<std::size_t, Is>...>;
+};
+
+TEST(Visit, strategies) {
+    std::string test29;
+    auto sum = [](auto a, auto b) { return double(a) + double(b); };
+    vr::variant<int, double, char> x(2.5);
+    vr::variant<int, double, char> y('a');
+    test29 += std::to_string(vr::visit_with<vr::visit_strategy::table>(sum, x, y)) + " ";
+    test29 += std::to_string(vr::visit_with<vr::visit_strategy::inline_switch>(sum, x, y)) + " ";
+
+    using narrow = wide_variant<std::make_index_sequence<20>>::type;
+    using wide = wide_variant<std::make_index_sequence<VR_SWITCH_VISIT_MAX + 3>>::type;
+    auto value = [](auto a) { return decltype(a)::value; };
+    narrow n(std::in_place_index<17>);
+    wide w(std::in_place_index<VR_SWITCH_VISIT_MAX + 1>);
+    test29 += std::to_string(vr::visit(value, n)) + " " + std::to_string(vr::visit_with<vr::visit_strategy::table>(value, n)) + " ";
+    test29 += std::to_string(vr::visit(value, w) - VR_SWITCH_VISIT_MAX);
+    EXPECT_EQ(test29, "99.500000 99.500000 17 17 1");
+}
+
+TEST(Visit, flat_table) {
+    using small = wide_variant<std::make_index_sequence<2>>::type;
+    using medium = wide_variant<std::make_index_sequence<3>>::type;
+    using large = wide_variant<std::make_index_sequence<12>>::type;
+    auto code = [](auto a, auto b, auto c) { return decltype(a)::value * 100 + decltype(b)::value * 10 + decltype(c)::value; };
+
+    std::string test30;
+    small a(std::in_place_index<1>);
+    medium b(std::in_place_index<2>);
+    large c(std::in_place_index<9>);
+    test30 += std::to_string(vr::visit(code, a, b, c)) + " ";
+    test30 += std::to_string(vr::visit_with<vr::visit_strategy::table>(code, c, b, a)) + " ";
+    test30 += std::to_string(vr::visit(code, b, c, b));
+    EXPECT_EQ(test30, "129 921 292");
+}
+
+struct circle {};
+struct square {};
+struct triangle {};
+
+struct collide {
+    using combinations = vr::combinations<vr::combination<circle, circle>,
+                                          vr::combination<circle, square>,
+                                          vr::combination<square, triangle>>;
+
+    std::string operator()(circle, circle) const { return "cc"; }
+    std::string operator()(circle, square) const { return "cs"; }
+    std::string operator()(square, triangle) const { return "st"; }
+};
+
+TEST(Visit, sparse) {
+    using shape = vr::variant<circle, square, triangle>;
+    auto fallback = [](shape const& a, shape const& b) { return "-" + std::to_string(a.index()) + std::to_string(b.index()); };
+
+    std::string test31;
+    std::vector<shape> shapes{circle(), square(), triangle()};
+    for (shape const& a : shapes) {
+        for (shape const& b : shapes) {
+            test31 += vr::visit_sparse(collide(), fallback, a, b) + " ";
+        }
+    }
+    EXPECT_EQ(test31, "cc cs -02 -10 -11 st -20 -21 -22 ");
+}
+
+struct counted {
+    static inline int alive = 0;
+    counted() { ++alive; }
+    counted(counted const&) { ++alive; }
+    counted(counted&&) { ++alive; }
+    counted& operator =(counted const&) = default;
+    counted& operator =(counted&&) = default;
+    ~counted() { --alive; }
+};
+
+TEST(Operations, shared_table) {
+    using first = vr::details::storage::operations<int, std::string>;
+    using second = vr::details::storage::operations<std::string, double, counted>;
+    EXPECT_EQ(first::table[1].destroy, second::table[0].destroy);
+    EXPECT_EQ(first::table[1].copy_construct, second::table[0].copy_construct);
+
+    std::string test32;
+    {
+        vr::variant<int, std::string, counted> a(std::in_place_type<counted>);
+        vr::variant<int, std::string, counted> b(a);
+        vr::variant<int, std::string, counted> c(std::string("c"));
+        test32 += std::to_string(counted::alive);
+        c = a;
+        test32 += std::to_string(counted::alive);
+        a = vr::variant<int, std::string, counted>(1);
+        test32 += std::to_string(counted::alive);
+        swap(b, c);
+        b = std::move(a);
+        test32 += std::to_string(counted::alive);
+        c = std::string("c");
+        test32 += vr::get<std::string>(c);
+    }
+    test32 += std::to_string(counted::alive);
+    EXPECT_EQ(test32, "2321c0");
+}
+
+struct hot_message { int id; };
+struct cold_message { std::string text; };
+using message = vr::variant<cold_message, int, hot_message>;
+
+template<>
+struct vr::hot_alternatives<message> {
+    using type = vr::likely<hot_message>;
+};
+
+TEST(Visit, likely) {
+    auto describe = [](auto const& m) -> std::string {
+        using type = std::decay_t<decltype(m)>;
+        if constexpr (std::is_same_v<type, hot_message>) return "hot" + std::to_string(m.id);
+        else if constexpr (std::is_same_v<type, cold_message>) return m.text;
+        else return std::to_string(m);
+    };
+
+    std::string test33;
+    message hot(hot_message{1});
+    message cold(cold_message{"cold"});
+    message number(7);
+    test33 += vr::visit(describe, hot) + vr::visit(describe, cold) + vr::visit(describe, number) + " ";
+    test33 += vr::visit_likely<int, cold_message>(describe, hot) + vr::visit_likely<int, cold_message>(describe, cold);
+    test33 += vr::visit_likely<int>(describe, std::as_const(number));
+    EXPECT_EQ(test33, "hot1cold7 hot1cold7");
+}
+
+TEST(Operations, trivially_copyable_mask) {
+    using ops = vr::details::storage::operations<int, std::string, double, counted>;
+    std::string test34;
+    for (std::size_t i = 0; i < 4; ++i) {
+        test34 += std::to_string(ops::trivially_copyable[i]);
+    }
+    EXPECT_EQ(test34, "1010");
+
+    vr::variant<int, std::string, double, counted> a(2.5);
+    vr::variant<int, std::string, double, counted> b(a);
+    vr::variant<int, std::string, double, counted> c(std::string("c"));
+    c = b;
+    b = std::string("b");
+    vr::variant<int, std::string, double, counted> d(std::move(b));
+    test34 += " " + std::to_string(vr::get<double>(c)) + vr::get<std::string>(d);
+    EXPECT_EQ(test34, "1010 2.500000b");
+}
+
+struct handle {
+    std::unique_ptr<int> p;
+    explicit handle(int x) : p(new int(x)) {}
+};
+
+template<>
+struct vr::is_trivially_relocatable<handle> : std::true_type {};
+
+TEST(Relocation, swap_and_erase) {
+    using value = vr::variant<int, handle>;
+    static_assert(vr::is_trivially_relocatable_v<value>);
+    static_assert(!vr::is_trivially_relocatable_v<vr::variant<int, std::string>>);
+
+    value a(std::in_place_type<handle>, 1);
+    value b(7);
+    a.swap(b);
+    std::string test35 = std::to_string(vr::get<int>(a)) + std::to_string(*vr::get<handle>(b).p);
+
+    std::vector<value> values;
+    for (int i = 0; i < 6; ++i) {
+        if (i % 2) values.emplace_back(std::in_place_type<handle>, i);
+        else values.emplace_back(i);
+    }
+    auto it = vr::relocate_erase(values, values.cbegin() + 1, values.cbegin() + 3);
+    test35 += " " + std::to_string(it - values.begin()) + ":";
+    for (value const& v : values) {
+        test35 += std::to_string(v.index() == 1 ? *vr::get<handle>(v).p : vr::get<int>(v));
+    }
+
+    std::vector<vr::variant<int, std::string>> strings{1, std::string("two"), 3};
+    vr::relocate_erase(strings, strings.cbegin());
+    test35 += " " + vr::get<std::string>(strings[0]) + std::to_string(strings.size());
+    EXPECT_EQ(test35, "71 1:0345 two2");
+}
+
+struct fragile {
+    explicit fragile(int x) : x(x) { if (x < 0) throw std::runtime_error("fragile"); }
+    fragile(fragile const& other) : x(other.x) {}
+    fragile(fragile&& other) : x(other.x) {}
+    fragile& operator =(fragile const&) = default;
+    int x;
+};
+
+TEST(Strict_variant, never_empty) {
+    vr::strict_variant<int, std::string> a(std::string("a"));
+    a = 5;
+    a.emplace<std::string>(3, 'b');
+    std::string test36 = vr::get<std::string>(a) + std::to_string(a.index());
+
+    vr::strict_variant<vr::monostate, fragile> b(std::in_place_type<fragile>, 1);
+    try {
+        b.emplace<fragile>(-1);
+    } catch (std::runtime_error const&) {
+        test36 += " caught";
+    }
+    test36 += std::to_string(b.index()) + std::to_string(b.valueless_by_exception());
+
+    vr::strict_variant<vr::monostate, fragile> c(std::in_place_type<fragile>, 7);
+    b = c;
+    test36 += " " + vr::visit([](auto const& v) -> std::string {
+        if constexpr (std::is_same_v<std::decay_t<decltype(v)>, fragile>) return "fragile" + std::to_string(v.x);
+        else return "monostate";
+    }, b);
+    vr::strict_variant<int, std::string> d(1);
+    swap(a, d);
+    test36 += " " + std::to_string(vr::get<int>(a)) + vr::get<std::string>(d);
+    EXPECT_EQ(test36, "bbb1 caught00 fragile7 1bbb");
+}
+
+TEST(Visit, valueless_throws) {
+    vr::variant<int, fragile> v(1);
+    vr::variant<int, fragile> w(2);
+    try {
+        v.emplace<fragile>(-1);
+    } catch (std::runtime_error const&) {}
+    std::string test53 = std::to_string(v.valueless_by_exception());
+    auto visited = [](auto const&...) { return std::string(" visited"); };
+    auto attempt = [&](auto&& call) {
+        try {
+            test53 += call();
+        } catch (vr::bad_variant_access const&) {
+            test53 += "!";
+        }
+    };
+    attempt([&] { return vr::visit(visited, v); });
+    attempt([&] { return vr::visit(visited, w, v); });
+    attempt([&] { return vr::visit_with<vr::visit_strategy::table>(visited, v); });
+    attempt([&] { return vr::visit_likely<int>(visited, v); });
+    attempt([&] { return vr::visit(visited, w); });
+    EXPECT_EQ(test53, "1!!!! visited");
+}
+
+TEST(Access, try_get_unchecked) {
+    vr::variant<int, std::string> a(std::string("a"));
+    vr::strict_variant<int, double> b(2.5);
+    std::string test37;
+    test37 += std::to_string(vr::try_get<int>(a) == nullptr) + *vr::try_get<1>(a);
+    vr::get_unchecked<std::string>(a) += "b";
+    test37 += " " + vr::get_unchecked<1>(std::as_const(a)) + std::to_string(vr::get_unchecked<double>(b));
+    test37 += " " + std::to_string(vr::try_get<double>(b) != nullptr) + std::to_string(vr::try_get<0>(b) == nullptr);
+    EXPECT_EQ(test37, "1a ab2.500000 11");
+}
+
+TEST(Boxed, transparent_access) {
+    using value = vr::boxing_variant<16, int, stype>;
+    static_assert(std::is_same_v<vr::variant_alternative_t<1, value>, vr::boxed<stype>>);
+    static_assert(sizeof(value) == 2 * sizeof(void*));
+
+    value a(stype(1, 2.5, "s"));
+    std::string test38 = vr::get<stype>(a).s + std::to_string(vr::holds_alternative<stype>(a));
+    vr::get<1>(a).x = 5;
+    auto describe = [](auto const& v) -> std::string {
+        if constexpr (std::is_same_v<std::decay_t<decltype(v)>, stype>) return "stype" + std::to_string(v.x);
+        else return "int" + std::to_string(v);
+    };
+    test38 += " " + vr::visit(describe, a);
+
+    value b(a);
+    vr::get<stype>(b).x = 9;
+    test38 += " " + std::to_string(vr::get_if<stype>(&a)->x) + std::to_string(vr::get<stype>(b).x);
+
+    a = 3;
+    b.emplace<stype>(7, 1.0, "e");
+    value c(std::move(b));
+    test38 += " " + vr::visit(describe, a) + vr::visit(describe, c) + vr::get<stype>(c).s;
+
+    test38 += " " + std::to_string(b.valueless_by_exception()) + std::to_string(vr::get_if<stype>(&b) == nullptr);
+    try {
+        vr::visit(describe, b);
+    } catch (vr::bad_variant_access const&) {
+        test38 += "!";
+    }
+    a = std::move(c);
+    test38 += std::to_string(c.valueless_by_exception()) + std::to_string(c.index() == vr::variant_npos) + vr::get<stype>(a).s;
+    b = a;
+    test38 += vr::visit(describe, b);
+    EXPECT_EQ(test38, "s1 stype5 59 int3stype7e 11!11estype7");
+}
+
+struct box_payload {
+    char bytes[200];
+};
+
+TEST(Boxed, freed_in_other_thread) {
+    using pool = vr::details::box_pool::pool_for<box_payload>;
+    for (int round = 0; round < 20; ++round) {
+        std::vector<vr::boxed<box_payload>> produced;
+        for (int i = 0; i < 1000; ++i) produced.emplace_back(box_payload{});
+        std::thread consumer([batch = std::move(produced)]() mutable { batch.clear(); });
+        consumer.join();
+    }
+    std::size_t chunks = pool::registry().owned.size();
+    std::string test52 = std::to_string(chunks < 2 * 1000 / pool::chunk_nodes + 4);
+    EXPECT_EQ(test52, "1");
+}
+
+/// Разрушается после реестра кусков пула, который создается позже - при первом выделении
+vr::variant<int, vr::boxed<box_payload>> global_boxed(1);
+
+TEST(Boxed, static_lifetime) {
+    box_payload payload{};
+    payload.bytes[0] = 'g';
+    global_boxed = vr::boxed<box_payload>(payload);
+    std::string test55(1, vr::get<box_payload>(global_boxed).bytes[0]);
+    EXPECT_EQ(test55, "g");
+}
+
+struct counting_resource : std::pmr::memory_resource {
+    int allocations = 0;
+
+    void* do_allocate(std::size_t bytes, std::size_t align) override {
+        ++allocations;
+        return std::pmr::new_delete_resource()->allocate(bytes, align);
+    }
+    void do_deallocate(void* p, std::size_t bytes, std::size_t align) override {
+        std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+    }
+    bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+TEST(Allocator_variant, uses_allocator) {
+    counting_resource resource;
+    std::string const long_text(64, 'x');
+    using value = vr::pmr::variant<int, std::pmr::string, std::pmr::vector<int>>;
+
+    value a(std::allocator_arg, &resource, 1);
+    a = std::pmr::string(long_text.c_str());
+    std::string test39 = std::to_string(vr::get<std::pmr::string>(a).get_allocator().resource() == &resource);
+    a.emplace<std::pmr::vector<int>>(100, 7);
+    test39 += std::to_string(vr::get<2>(a).get_allocator().resource() == &resource);
+
+    value b(std::allocator_arg, &resource, std::in_place_index<1>, long_text.c_str());
+    b = a;
+    test39 += std::to_string(vr::get<2>(b).size()) + std::to_string(b.get_allocator().resource() == &resource);
+    test39 += " " + std::to_string(vr::visit([](auto const& v) -> std::size_t {
+        if constexpr (std::is_same_v<std::decay_t<decltype(v)>, int>) return 0;
+        else return v.size();
+    }, b));
+    test39 += " " + std::to_string(resource.allocations);
+
+    value c(std::in_place_type<std::pmr::string>, "abc");
+    value d(std::in_place_index<2>, 3, 1);
+    test39 += " " + std::string(vr::get<1>(c)) + std::to_string(vr::get<2>(d).size()) +
+              std::to_string(c.get_allocator().resource() == std::pmr::get_default_resource());
+    EXPECT_EQ(test39, "111001 100 4 abc31");
+}
+
+TEST(Shared_variant, copy_on_write) {
+    vr::shared_variant<int, std::string> a(std::string(40, 'a'));
+    vr::shared_variant<int, std::string> b(a);
+    vr::shared_variant<int, std::string> const c(b);
+    std::string test40 = std::to_string(a.use_count()) + std::to_string(&vr::get<1>(c) == &vr::get<1>(std::as_const(a)));
+
+    vr::get<std::string>(b) = "b";
+    test40 += " " + std::to_string(a.use_count()) + std::to_string(b.use_count()) + vr::get<std::string>(b) + std::to_string(vr::get<1>(std::as_const(a)).size());
+
+    a.emplace<int>(7);
+    test40 += " " + std::to_string(vr::get<int>(a)) + std::to_string(c.use_count()) + std::to_string(vr::holds_alternative<std::string>(c));
+    test40 += " " + vr::visit([](auto const& v) -> std::string {
+        if constexpr (std::is_same_v<std::decay_t<decltype(v)>, int>) return std::to_string(v);
+        else return v;
+    }, b);
+
+    vr::local_shared_variant<int, std::string> d(5);
+    vr::local_shared_variant<int, std::string> e(d);
+    e = std::string("e");
+    test40 += " " + std::to_string(vr::get<int>(d)) + vr::get<std::string>(e) + std::to_string(d.unique());
+
+    vr::shared_variant<int, std::string> moved(std::move(b));
+    test40 += " " + std::to_string(b.valueless_by_exception()) + std::to_string(b.value().valueless_by_exception());
+    try {
+        vr::visit([](auto const&) {}, b);
+    } catch (vr::bad_variant_access const&) {
+        test40 += "!";
+    }
+    b.mutate() = 9;
+    test40 += std::to_string(vr::get<int>(b)) + std::to_string(b.unique());
+    EXPECT_EQ(test40, "31 21b40 711 b 5e1 11!91");
+}
+
+TEST(Variant_ref, zero_copy) {
+    struct describe {
+        std::string operator()(int const& i) const { return "i" + std::to_string(i); }
+        std::string operator()(std::string const& s) const { return "s" + s; }
+    };
+    auto print = [](vr::const_variant_ref<int, std::string> arg) { return vr::visit(describe(), arg); };
+
+    int i = 4;
+    std::string s = "str";
+    vr::variant<int, std::string> v(std::string("var"));
+    std::string test41 = print(i) + print(std::as_const(s)) + print(v) + std::to_string(sizeof(vr::variant_ref<int, std::string>) == 2 * sizeof(void*));
+
+    vr::variant_ref<int, std::string> r(v);
+    vr::get<std::string>(r) += "!";
+    r = i;
+    vr::get<0>(r) = 5;
+    vr::const_variant_ref<int, std::string> c(r);
+    test41 += " " + vr::get<1>(v) + std::to_string(i) + std::to_string(vr::holds_alternative<int>(c)) + std::to_string(vr::get_if<1>(&c) == nullptr);
+
+    vr::variant_ref<int, std::string> t(s);
+    test41 += " " + vr::visit([](auto& a, auto& b) { return std::to_string(sizeof(a) == sizeof(b)); }, r, t) + t.visit(describe());
+    EXPECT_EQ(test41, "i4sstrsvar1 var!511 0sstr");
+
+    static_assert(std::is_constructible_v<vr::const_variant_ref<int>, vr::variant<int> const&>);
+    static_assert(!std::is_constructible_v<vr::const_variant_ref<int>, vr::variant<int>>);
+    static_assert(!std::is_constructible_v<vr::const_variant_ref<int>, vr::variant<int> const&&>);
+}
+
+TEST(Variant_cast, widen_narrow_reorder) {
+    vr::variant<int, double> number(2.5);
+    auto wide = vr::variant_cast<vr::variant<std::string, int, double>>(number);
+    static_assert(std::is_same_v<decltype(wide), vr::variant<std::string, int, double>>);
+    std::string test42 = std::to_string(wide.index()) + std::to_string(vr::get<double>(wide));
+
+    auto narrow = vr::variant_cast<vr::variant<int>>(number);
+    static_assert(std::is_same_v<decltype(narrow), std::optional<vr::variant<int>>>);
+    number = 7;
+    auto back = vr::variant_cast<vr::variant<int>>(number);
+    test42 += " " + std::to_string(narrow.has_value()) + std::to_string(vr::get<0>(*back));
+
+    vr::variant<std::string, int, double> text(std::string(30, 's'));
+    auto reordered = vr::variant_cast<vr::variant<double, std::string, int>>(std::move(text));
+    auto lost = vr::variant_cast<vr::variant<int, double>>(wide);
+    auto kept = vr::variant_cast<vr::variant<int, double>>(reordered);
+    test42 += " " + std::to_string(reordered.index()) + std::to_string(vr::get<1>(reordered).size()) + std::to_string(vr::get<0>(text).size()) +
+              std::to_string(lost.has_value()) + std::to_string(kept.has_value());
+    EXPECT_EQ(test42, "22.500000 07 130010");
+}
+
+TEST(Flatten, flat_leaf_index) {
+    using inner = vr::variant<char, vr::variant<long, std::string>>;
+    using message = vr::variant<int, vr::variant<double, float>, inner>;
+    static_assert(std::is_same_v<vr::flatten_t<message>, vr::variant<int, double, float, char, long, std::string>>);
+
+    struct describe {
+        std::string operator()(int i) const { return "i" + std::to_string(i); }
+        std::string operator()(double) const { return "d"; }
+        std::string operator()(float) const { return "f"; }
+        std::string operator()(char c) const { return std::string("c") + c; }
+        std::string operator()(long l) const { return "l" + std::to_string(l); }
+        std::string operator()(std::string const& s) const { return "s" + s; }
+    };
+
+    message a(3);
+    message b(vr::variant<double, float>(1.5f));
+    message c(inner(vr::variant<long, std::string>(std::string("leaf"))));
+    message d(inner('x'));
+    std::string test43 = vr::visit_flat(describe(), a) + vr::visit_flat(describe(), b) + vr::visit_flat(describe(), c) + vr::visit_flat(describe(), d);
+
+    vr::flatten_t<message> flat = vr::flatten(c);
+    auto ref = vr::flatten_ref(c);
+    vr::get<std::string>(ref) += "!";
+    auto cref = vr::flatten_ref(std::as_const(d));
+    test43 += " " + std::to_string(flat.index()) + vr::get<5>(flat) + std::to_string(ref.index()) + vr::visit(describe(), ref) + vr::visit(describe(), cref);
+
+    vr::flatten_t<message> moved = vr::flatten(std::move(c));
+    test43 += " " + vr::get<std::string>(moved) + std::to_string(vr::get<1>(vr::get<1>(vr::get<2>(c))).size());
+    EXPECT_EQ(test43, "i3fsleafcx 5leaf5sleaf!cx leaf!0");
+}
+
+TEST(Transform, fused_chain) {
+    vr::variant<int, double, std::string> v(std::string("four"));
+    auto length = [](auto const& x) -> std::size_t {
+        if constexpr (std::is_same_v<std::decay_t<decltype(x)>, std::string>) return x.size();
+        else return static_cast<std::size_t>(x);
+    };
+    auto n = vr::transform(v, length);
+    static_assert(std::is_same_v<decltype(n), vr::variant<std::size_t>>);
+    std::string test44 = std::to_string(vr::get<0>(n));
+
+    int calls = 0;
+    auto twice = [&](auto x) { ++calls; return x + x; };
+    auto describe = [&](auto const& x) -> std::variant<long, std::string> {
+        ++calls;
+        if constexpr (std::is_same_v<std::decay_t<decltype(x)>, std::string>) return x;
+        else return static_cast<long>(x);
+    };
+    auto name = [](auto const& x) {
+        if constexpr (std::is_same_v<std::decay_t<decltype(x)>, std::string>) return x;
+        else return std::to_string(x);
+    };
+    vr::variant<std::string> s = v | vr::map(twice) | vr::map(name);
+    test44 += " " + vr::get<std::string>(s) + std::to_string(calls);
+
+    v = 21;
+    auto chained = (v | vr::map(twice) | vr::map(describe)).collect();
+    static_assert(std::is_same_v<decltype(chained), vr::variant<std::variant<long, std::string>>>);
+    test44 += " " + std::to_string(std::get<long>(vr::get<0>(chained))) + std::to_string(calls);
+    test44 += " " + vr::visit(name, vr::variant<int, std::string>(5) | vr::map(twice));
+    EXPECT_EQ(test44, "4 fourfour1 423 10");
+}
+
+TEST(Emplace, factory_and_forwarding) {
+    struct pinned {
+        explicit pinned(int v) : value(v) {}
+        pinned(pinned const&) = delete;
+        pinned(pinned&&) = delete;
+        int value;
+    };
+    struct counted {
+        counted(std::string& log) : log(&log) {}
+        counted(counted const& other) : log(other.log) { *log += "c"; }
+        counted(counted&& other) noexcept : log(other.log) { *log += "m"; }
+        std::string* log;
+    };
+
+    vr::variant<int, pinned> p;
+    pinned& made = p.emplace_with<pinned>([] { return pinned(8); });
+    std::string test45 = std::to_string(made.value) + std::to_string(p.index());
+
+    std::string log;
+    counted source(log);
+    vr::variant<int, counted> c;
+    c.emplace<1>(source);
+    c.emplace<counted>(std::move(source));
+    c.emplace_with<1>([&]() noexcept { return counted(log); });
+    test45 += " " + log;
+
+    vr::variant<int, std::string> s(std::string("keep"));
+    try {
+        s.emplace_with<std::string>([]() -> std::string { throw std::runtime_error("factory"); });
+    } catch (std::runtime_error const&) {
+        test45 += " " + vr::get<std::string>(s);
+    }
+    vr::variant<int, std::vector<int>> l;
+    test45 += " " + std::to_string(s.emplace<0>(3) + l.emplace<1>({1, 2}).size() + l.emplace<std::vector<int>>({1}).size());
+
+    vr::variant<std::string, std::vector<std::string>> owner(std::vector<std::string>{std::string(40, 'o')});
+    vr::variant<int, std::pair<int, int>> inside(5);
+    auto const& pair = inside.emplace<1>(1, vr::get<0>(inside));
+    test45 += " " + std::to_string(owner.emplace<0>(vr::get<1>(owner).front()).size()) + std::to_string(pair.first) + std::to_string(pair.second);
+    EXPECT_EQ(test45, "81 cm keep 6 4015");
+}
+
+TEST(Comparison, single_dispatch) {
+    using value = vr::variant<int, std::string, double>;
+    std::vector<value> values = {std::string("b"), 3, 2.5, 1, std::string("a"), 3, std::string("b"), 2.5};
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+    std::string test46;
+    for (value const& v : values) {
+        test46 += vr::visit([](auto const& x) {
+            if constexpr (std::is_same_v<std::decay_t<decltype(x)>, std::string>) return x;
+            else return std::to_string(x).substr(0, 3);
+        }, v) + ",";
+    }
+
+    value a(2), b(std::string("x"));
+    test46 += " " + std::to_string(a < b) + std::to_string(a >= b) + std::to_string(b > a) + std::to_string(a != b) + std::to_string(b <= b) + std::to_string(a == value(2));
+    test46 += " " + std::to_string(a == 2) + std::to_string(2 == a) + std::to_string(a < 3) + std::to_string(a < std::string("a")) +
+              std::to_string(b == std::string("x")) + std::to_string(std::string("y") > b) + std::to_string(b >= 1.5) + std::to_string(0.5 <= a);
+#if VR_HAS_THREE_WAY_COMPARISON
+    test46 += (a <=> b) < 0 ? " lt" : " ge";
+#else
+    test46 += " lt";
+#endif
+    EXPECT_EQ(test46, "1,3,a,b,2.5, 101111 11111100 lt");
+}
+
+TEST(Hash, transparent_and_batch) {
+    using key = vr::variant<int, std::string>;
+    vr::hash<key> hasher;
+    vr::equal_to<key> equal;
+    std::string test47 = std::to_string(hasher(key(std::string("ab"))) == hasher(std::string_view("ab"))) +
+                         std::to_string(hasher(key(7)) == hasher(7)) + std::to_string(hasher("ab") == hasher(std::string("ab"))) +
+                         std::to_string(hasher(key(1)) != hasher(key(std::string("1"))));
+    test47 += " " + std::to_string(equal(key(std::string("ab")), std::string_view("ab"))) + std::to_string(equal("ab", key(std::string("ab")))) +
+              std::to_string(equal(key(7), std::string_view("7"))) + std::to_string(equal(key(7), 7));
+
+    std::unordered_map<key, int, vr::hash<key>, vr::equal_to<key>> counts;
+    for (key k : {key(1), key(std::string("x")), key(1), key(std::string("y")), key(std::string("x"))}) ++counts[k];
+    test47 += " " + std::to_string(counts.size()) + std::to_string(counts[key(std::string("x"))]) + std::to_string(std::unordered_set<key>{key(2), key(2)}.size());
+#if defined(__cpp_lib_generic_unordered_lookup)
+    test47 += std::to_string(counts.find(std::string_view("y"))->second);
+#else
+    test47 += "1";
+#endif
+
+    std::vector<key> values = {key(3), key(std::string("p")), key(4), key(std::string("q")), key(3)};
+    std::vector<std::size_t> hashes(values.size());
+    vr::hash_batch(values.data(), values.size(), hashes.data());
+    bool same = true;
+    for (std::size_t i = 0; i < values.size(); ++i) same = same && hashes[i] == hasher(values[i]);
+    test47 += " " + std::to_string(same) + std::to_string(hashes[0] == hashes[4]);
+    EXPECT_EQ(test47, "1111 1101 3211 11");
+}
+
+TEST(Hash, char_pointer_alternative) {
+    using key = vr::variant<int, char const*>;
+    char const first[] = "ab";
+    char const second[] = "ab";
+    std::unordered_set<key> keys = {key(static_cast<char const*>(nullptr)), key(first), key(second), key(first)};
+    vr::hash<key> hasher;
+    std::string test56 = std::to_string(keys.size()) + std::to_string(keys.count(key(static_cast<char const*>(nullptr)))) +
+                         std::to_string(hasher(key(first)) == hasher(static_cast<char const*>(first))) +
+                         std::to_string(vr::equal_to<key>()(key(first), static_cast<char const*>(second)));
+
+    using text = vr::variant<int, std::string>;
+    test56 += " " + std::to_string(vr::hash<text>()(text(std::string("ab"))) == vr::hash<text>()(static_cast<char const*>(first)));
+    EXPECT_EQ(test56, "3110 1");
+}
+
+TEST(Intern_pool, dedup_and_identity) {
+    using pool_t = vr::intern_pool<int, std::string>;
+    pool_t pool(4);
+    auto a = pool.intern(std::string("key"));
+    auto b = pool.intern(std::string_view("key"));
+    auto c = pool.intern("key");
+    auto d = pool.intern(vr::variant<int, std::string>(7));
+    auto e = pool.intern(7);
+    std::string test48 = std::to_string(a == b) + std::to_string(b == c) + std::to_string(d == e) + std::to_string(a != d) +
+                         std::to_string(pool.size()) + std::to_string(!pool.find(8)) + std::to_string(pool.find("key") == a);
+
+    std::unordered_set<pool_t::handle> handles = {a, b, c, d, e, pool_t::handle()};
+    test48 += " " + std::to_string(handles.size()) + std::to_string(vr::hash<pool_t::handle>()(a) == std::hash<pool_t::handle>()(c));
+    test48 += " " + vr::visit([](auto const& x) {
+        if constexpr (std::is_same_v<std::decay_t<decltype(x)>, std::string>) return x;
+        else return std::to_string(x);
+    }, a) + std::to_string(vr::get<int>(e)) + std::to_string(vr::holds_alternative<std::string>(b)) +
+              std::to_string(vr::get_if<int>(&a) == nullptr) + std::to_string(pool_t::handle().index() == vr::variant_npos);
+
+    std::vector<std::thread> threads;
+    std::vector<std::vector<pool_t::handle>> seen(4);
+    for (std::size_t t = 0; t < seen.size(); ++t) {
+        threads.emplace_back([&pool, &seen, t] {
+            for (int i = 0; i < 1000; ++i) seen[t].push_back(pool.intern(i % 2 ? vr::variant<int, std::string>(i) : std::to_string(i)));
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    bool same = true;
+    for (auto const& handles_of_thread : seen) same = same && handles_of_thread == seen[0];
+    test48 += " " + std::to_string(pool.size()) + std::to_string(same) + std::to_string(pool.intern(7) == e);
+
+    pool_t spread(8);
+    for (int i = 0; i < 1024; ++i) spread.intern(i);
+    bool even = true;
+    for (std::size_t i = 0; i < spread.shards(); ++i) even = even && spread.shard_size(i) > 64 && spread.shard_size(i) < 192;
+    test48 += " " + std::to_string(even);
+    EXPECT_EQ(test48, "1111211 31 key7111 100111 1");
+}
+
+TEST(Variant_vector, structure_of_arrays) {
+    vr::variant_vector<int, double, std::string> values;
+    values.push_back(1);
+    values.push_back(std::string("a"));
+    values.emplace<double>(2.5);
+    values.push_back(vr::variant<int, double, std::string>(std::string("b")));
+    values.emplace<0>(3);
+    values.push_back(vr::variant<int, double, std::string>(4));
+
+    auto print = [](auto const& x) {
+        if constexpr (std::is_same_v<std::decay_t<decltype(x)>, std::string>) return x;
+        else return std::to_string(x).substr(0, 3);
+    };
+    std::string test49;
+    for (std::size_t i = 0; i < values.size(); ++i) test49 += vr::visit(print, values[i]) + ",";
+
+    int sum = 0;
+    for (int x : values.values<int>()) sum += x;
+    test49 += " " + std::to_string(sum) + std::to_string(values.values<std::string>().size()) + std::to_string(values.count<double>());
+
+    values.erase(1);
+    vr::get<int>(values[3]) = 7;
+    values.at(2).visit([](auto& x) { if constexpr (std::is_same_v<std::decay_t<decltype(x)>, std::string>) x += "!"; });
+    auto const& view = values;
+    test49 += " ";
+    for (std::size_t i = 0; i < view.size(); ++i) test49 += vr::visit(print, view[i]) + std::to_string(view.index(i)) + ",";
+    test49 += " " + std::to_string(view.values<std::string>()[0] == "b!") + std::to_string(view.get_variant(3) == vr::variant<int, double, std::string>(7)) +
+              std::to_string(view.tags()[1]);
+    try {
+        values.at(10);
+    } catch (std::out_of_range const&) {
+        test49 += " range";
+    }
+    values.pop_back();
+    values.pop_back();
+    test49 += " " + std::to_string(values.size()) + std::to_string(values.values<int>().size());
+    EXPECT_EQ(test49, "1,a,2.5,b,3,4, 821 10,2.51,b!2,70,40, 111 range 31");
+}
+
+TEST(Visit_each, bucketed_and_ordered) {
+    using value = vr::variant<int, std::string, double>;
+    std::vector<value> values = {1, std::string("a"), 2.5, 2, std::string("b"), 3, 0.5};
+    std::string test50;
+    auto record = [&test50](auto const& x) {
+        if constexpr (std::is_same_v<std::decay_t<decltype(x)>, std::string>) test50 += x;
+        else test50 += std::to_string(x).substr(0, 3);
+        test50 += ",";
+    };
+    vr::visit_each(values, record);
+    test50 += " ";
+    vr::visit_each_ordered(values, record);
+
+    long total = 0;
+    vr::visit_each(values, [&total](auto& x) {
+        if constexpr (std::is_same_v<std::decay_t<decltype(x)>, std::string>) x += "!";
+        else total += static_cast<long>(x * 2);
+    });
+    test50 += " " + std::to_string(total) + vr::get<std::string>(values[4]);
+
+    vr::variant_vector<int, std::string, double> columns;
+    for (value const& v : values) columns.push_back(v);
+    test50 += " ";
+    vr::visit_each(std::as_const(columns), record);
+    test50 += " ";
+    vr::visit_each_ordered(columns, record);
+    EXPECT_EQ(test50, "1,2,3,a,b,2.5,0.5, 1,a,2.5,2,b,3,0.5, 18b! 1,2,3,a!,b!,2.5,0.5, 1,a!,2.5,2,b!,3,0.5,");
+}
+
+TEST(Tag_scan, simd_matches_scalar) {
+    using value = vr::variant<int, double, fragile>;
+    std::vector<value> values;
+    for (int i = 0; i < 1000; ++i) {
+        if (i % 7 == 3) values.emplace_back(std::in_place_index<1>, i * 0.5);
+        else if (i % 5 == 0) values.emplace_back(std::in_place_index<2>, i);
+        else values.emplace_back(i);
+    }
+    try {
+        values[998].emplace<fragile>(-1);
+    } catch (std::runtime_error const&) {}
+
+    std::vector<std::uint16_t> wide(300);
+    for (std::size_t i = 0; i < wide.size(); ++i) wide[i] = static_cast<std::uint16_t>(i % 3 == 0 ? 700 : i % 4);
+    vr::variant_vector<int, double, fragile> columns;
+    for (std::size_t i = 0; i < 130; ++i) if (!values[i].valueless_by_exception()) columns.push_back(values[i]);
+
+    auto scan = [&] {
+        std::vector<std::size_t> doubles = vr::find_alternative<double>(values.data(), values.size());
+        auto histogram = vr::alternative_histogram(values.data(), values.size());
+        std::vector<std::uint64_t> words((values.size() + 63) / 64);
+        vr::alternative_mask<fragile>(values.data(), values.size(), words.data());
+        std::vector<std::size_t> positions(values.size());
+        positions.resize(vr::mask_positions(words.data(), values.size(), positions.data()));
+        std::string result = std::to_string(vr::count_alternative<int>(values.data(), values.size())) + ":" +
+                             std::to_string(doubles.size()) + ":" + std::to_string(doubles[1]) + ":" + std::to_string(doubles.back()) + ":";
+        for (std::size_t h : histogram) result += std::to_string(h) + ",";
+        result += std::to_string(positions.size()) + ":" + std::to_string(positions.back()) + ":" +
+                  std::to_string(vr::mask_count(words.data(), values.size())) + ":" +
+                  std::to_string(vr::count_tag(wide.data(), wide.size(), 700)) + ":" + std::to_string(vr::find_tag(wide.data(), wide.size(), 1).size()) + ":" +
+                  std::to_string(vr::count_alternative<double>(columns)) + std::to_string(vr::find_alternative<double>(columns).size());
+        for (std::size_t h : vr::alternative_histogram(columns)) result += "," + std::to_string(h);
+        return result;
+    };
+
+    std::string best = scan();
+    std::string test51 = best + " ";
+    for (vr::simd_level level : {vr::simd_level::scalar, vr::simd_level::sse2}) {
+        vr::limit_tag_scan(level);
+        test51 += std::to_string(scan() == best);
+    }
+    vr::limit_tag_scan(vr::simd_level::avx2);
+    EXPECT_EQ(test51, "685:143:10:997:685,143,171,1,171:995:171:100:50:1919,89,19,22,0 11");
+}
+
 #endif // TST_ADF_H
@@ -2,21 +2,100 @@
 #define VARIANT_H
 
 #include <type_traits>
+#include <functional>
 #include <iostream>
 #include <new>
 #include <utility>
 #include <string>
 #include <array>
+#include <limits>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <cstdlib>
+#include <cassert>
+#include <optional>
+#include <string_view>
+#include <algorithm>
+
+/// [[no_unique_address]] позволяет пустым членам не занимать места (нужно для variant из одних тегов)
+#if defined(__has_cpp_attribute)
+#   if __has_cpp_attribute(no_unique_address)
+#       define VR_HAS_NO_UNIQUE_ADDRESS 1
+#       define VR_NO_UNIQUE_ADDRESS [[no_unique_address]]
+#   endif
+#endif
+
+#ifndef VR_NO_UNIQUE_ADDRESS
+#   define VR_HAS_NO_UNIQUE_ADDRESS 0
+#   define VR_NO_UNIQUE_ADDRESS
+#endif
+
+/// До скольких альтернатив visit разворачивается в switch (выше - таблица указателей на функции)
+#ifndef VR_SWITCH_VISIT_MAX
+#   define VR_SWITCH_VISIT_MAX 32
+#endif
+
+#if VR_SWITCH_VISIT_MAX > 32
+#   error "VR_SWITCH_VISIT_MAX can not exceed the 32 cases of the dispatch switch"
+#endif
+
+/// Сборка без исключений (-fno-exceptions или явный VR_NO_EXCEPTIONS): try/catch пропадают, а неудачный
+/// доступ к альтернативе вместо throw bad_variant_access() вызывает обработчик (см. set_bad_variant_access_handler),
+/// а прочие ошибки (выход за границы контейнера) - std::abort()
+#if !defined(VR_NO_EXCEPTIONS) && !(defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND))
+#   define VR_NO_EXCEPTIONS
+#endif
+
+#ifdef VR_NO_EXCEPTIONS
+#   define VR_TRY if constexpr (true)
+#   define VR_CATCH_ALL else
+#   define VR_RETHROW ((void)0)
+#else
+#   define VR_TRY try
+#   define VR_CATCH_ALL catch (...)
+#   define VR_RETHROW throw
+#endif
+
+/// operator<=> для variant, если его поддерживают и компилятор, и стандартная библиотека
+#if defined(__has_include)
+#   if __has_include(<compare>)
+#       include <compare>
+#   endif
+#endif
+
+#if defined(__cpp_impl_three_way_comparison) && defined(__cpp_lib_three_way_comparison)
+#   define VR_HAS_THREE_WAY_COMPARISON 1
+#else
+#   define VR_HAS_THREE_WAY_COMPARISON 0
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#   define VR_LIKELY(x) __builtin_expect(!!(x), 1)
+#else
+#   define VR_LIKELY(x) (x)
+#endif
 
 namespace vr {
 
 template<typename... Ts>
 struct variant;
 
+template<typename T>
+class boxed;
+
 /////////////////////////////////////////////////////// Helper objects //////////////////////////////////////////////////////////////////////////
 
 inline constexpr std::size_t variant_npos = -1;
 
+/// Как visit выбирает функцию по index():
+///     table         - таблица указателей на функции (косвенный вызов, который нельзя заинлайнить)
+///     inline_switch - цепочка if для 1-3 альтернатив, switch до VR_SWITCH_VISIT_MAX, выше - таблица
+enum class visit_strategy {
+    table,
+    inline_switch
+};
+
 /////////////////////////////////////////////////////// END Helper objects //////////////////////////////////////////////////////////////////////////
 
 
@@ -67,6 +146,94 @@ using variant_alternative_t = typename variant_alternative<I, T>::type;
 
 class bad_variant_access : public std::exception {};
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///     Без исключений get с неверной альтернативой вызывает обработчик (например, пишет в лог),
+///     а если он вернул управление - std::abort(). С исключениями обработчик не используется.
+
+using bad_variant_access_handler = void (*)();
+
+namespace details {
+
+    inline bad_variant_access_handler current_bad_variant_access_handler = nullptr;
+
+    [[noreturn]] inline void throw_bad_variant_access() {
+#ifdef VR_NO_EXCEPTIONS
+        if (current_bad_variant_access_handler) current_bad_variant_access_handler();
+        std::abort();
+#else
+        throw bad_variant_access();
+#endif
+    }
+
+    /// Прочие ошибки контейнеров (std::out_of_range, std::length_error): без исключений - std::abort()
+    template<typename E>
+    [[noreturn]] void throw_error(char const* what) {
+#ifdef VR_NO_EXCEPTIONS
+        (void)what;
+        std::abort();
+#else
+        throw E(what);
+#endif
+    }
+
+} // details end
+
+/// Возвращает предыдущий обработчик
+inline bad_variant_access_handler set_bad_variant_access_handler(bad_variant_access_handler handler) noexcept {
+    bad_variant_access_handler previous = details::current_bad_variant_access_handler;
+    details::current_bad_variant_access_handler = handler;
+    return previous;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///     Допустимые сочетания альтернатив для visit_sparse:
+///     struct rule { using combinations = vr::combinations<vr::combination<A, B>, vr::combination<C, C>>; ... };
+
+template<typename... Ts>
+struct combination {};
+
+template<typename... Cs>
+struct combinations {};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///     "Горячие" альтернативы: перед общей диспетчеризацией visit проверяет их по очереди сравнением индекса
+///     с подсказкой предсказателю ветвлений. Для одного вызова - visit_likely<A, B>(f, v), для типа варианта -
+///     template<> struct vr::hot_alternatives<my_variant> { using type = vr::likely<A>; };
+
+template<typename... Ts>
+struct likely {};
+
+template<typename V>
+struct hot_alternatives {
+    using type = likely<>;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///     Тип, объект которого можно перенести в другое место копированием байтов (без move + destroy).
+///     По умолчанию - тривиально копируемые типы; для своих типов (unique_ptr-подобных, контейнеров без
+///     указателей на себя) специализируется: template<> struct vr::is_trivially_relocatable<my_type> : std::true_type {};
+///     Тогда swap вариантов и uninitialized_relocate / relocate_erase работают через memcpy / memmove.
+
+template<typename T>
+struct is_trivially_relocatable : std::bool_constant<std::is_trivially_copyable_v<T>> {};
+
+template<typename T>
+inline constexpr bool is_trivially_relocatable_v = is_trivially_relocatable<T>::value;
+
+template<typename... Ts>
+struct is_trivially_relocatable<variant<Ts...>> : std::bool_constant<(is_trivially_relocatable_v<Ts> && ...)> {};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///     Тип, объект которого после перемещения из него пуст и непригоден для чтения (как boxed<T>).
+///     Вариант, из которого переместили такую альтернативу, становится valueless_by_exception:
+///     visit и get бросают bad_variant_access вместо чтения пустого объекта.
+
+template<typename T>
+struct is_empty_after_move : std::false_type {};
+
+template<typename T>
+inline constexpr bool is_empty_after_move_v = is_empty_after_move<T>::value;
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 struct monostate {};
@@ -83,11 +250,13 @@ constexpr bool operator!=(monostate, monostate) noexcept { return false; }
 /// http://en.cppreference.com/w/cpp/utility/hash
 ///
 
-//template<typename... Types>
-//struct hash<variant<Types...>> {};                                                                                    //////// TODO
+/// Для остальных типов - std::hash; hash<variant<Ts...>> и прозрачный equal_to<variant<Ts...>> - после non-member функций
 
 template<typename T>
-struct hash;
+struct hash : std::hash<T> {};
+
+template<typename T>
+struct equal_to : std::equal_to<T> {};
 
 template <>
 struct hash<monostate> {
@@ -179,6 +348,53 @@ namespace details {
     template<typename T, typename... Ts>
     inline constexpr std::size_t get_id_at_v = get_id_at_checked<T, Ts...>::value;
 
+////////////////////////////////////////////////////////////////////////////
+
+    /// Альтернатива boxed<T> снаружи выглядит как T: visit и get отдают T&, а искать ее можно по T
+
+    template<typename T>
+    struct unboxed {
+        using type = T;
+    };
+
+    template<typename T>
+    struct unboxed<boxed<T>> {
+        using type = T;
+    };
+
+    template<typename T>
+    using unboxed_t = typename unboxed<T>::type;
+
+    template<typename A>
+    constexpr decltype(auto) unbox(A&& a) noexcept {
+        if constexpr (std::is_same_v<unboxed_t<std::decay_t<A>>, std::decay_t<A>>) {
+            return std::forward<A>(a);
+        } else {
+            return *std::forward<A>(a);
+        }
+    }
+
+    /// T строится из результата f(): prvalue самого T подходит и для неперемещаемого T
+    template<typename T, typename F, typename R = std::invoke_result_t<F>>
+    inline constexpr bool constructible_from_result_v = std::is_same_v<std::remove_cv_t<R>, T> || std::is_constructible_v<T, R>;
+
+    template<typename T, typename... Ts>
+    inline constexpr bool has_alternative_v = (std::is_same_v<T, Ts> || ...) || (std::is_same_v<T, unboxed_t<Ts>> || ...);
+
+    template<typename T, typename... Ts>
+    inline constexpr std::size_t alternative_index_v = (std::is_same_v<T, Ts> || ...) ? get_id_at_v<T, Ts...>
+                                                                                       : get_id_at_v<T, unboxed_t<Ts>...>;
+
+////////////////////////////////////////////////////////////////////////////
+
+    /// Наименьший беззнаковый тип, в который помещаются индексы 0..N-1 и variant_npos
+    /// (variant_npos хранится как максимальное значение типа)
+
+    template<std::size_t N>
+    using variant_index_t = std::conditional_t<(N <= std::numeric_limits<unsigned char>::max()), unsigned char,
+                            std::conditional_t<(N <= std::numeric_limits<unsigned short>::max()), unsigned short,
+                            std::conditional_t<(N <= std::numeric_limits<unsigned int>::max()), unsigned int, std::size_t>>>;
+
 ////////////////////////////////////////////////////////////////////////////
 
     template<typename T>
@@ -282,29 +498,49 @@ namespace details {
             static constexpr auto&& get_alternative(V&& v) {
               return storage_base_helper::get_alternative<I>(std::forward<V>(v).storage);
             }
-        };
-
-    }
 
-    namespace visitor {
+            /// Значение альтернативы I (для boxed<T> - сам T)
+            template <std::size_t I, typename V>
+            static constexpr decltype(auto) get_value(V&& v) {
+              return unbox(get_alternative<I>(std::forward<V>(v)).value);
+            }
 
-        struct storage_base_helper {
+            /// Байты v перенесены в другое место: деструктор v больше ничего не должен делать
+            template <typename V>
+            static void forget(V& v) noexcept {
+              v.storage.indx = v.storage.npos_index;
+            }
 
-            template<typename T>
-            constexpr static const T& at(T const& value) {
-                return value;
+            /// Смещение хранимого индекса от начала V в байтах (одно для всех объектов V): в массиве вариантов
+            /// теги лежат с шагом sizeof(V) начиная с этого байта (tag_scan)
+            template <typename V>
+            static std::size_t index_offset(V const& v) noexcept {
+              return static_cast<std::size_t>(reinterpret_cast<char const*>(&v.storage.indx) - reinterpret_cast<char const*>(&v));
             }
 
-            template<std::size_t N, typename T, typename... RestCoordinates>
-            constexpr static auto const& at(std::array<T, N> const& ar, std::size_t x, RestCoordinates... rest_coordinates) {
-                   return at(ar[x], rest_coordinates...);
+            /// variant без значения, хранилище которого дальше заполняют байтами (variant_cast)
+            template <typename V>
+            static V make_valueless() {
+              return V(typename V::valueless_tag());
             }
 
-            template <typename F, typename... Fs>
-            static constexpr int visit_visitor_return_type_check() {
-                static_assert(is_unique_type_v<F, Fs...>, "`visit` requires the visitor to have a single ""return type.");
-                return 0;
+            /// Копирует байты активной альтернативы from в пустой to, где она становится альтернативой index.
+            /// Только для тривиально копируемой альтернативы одного типа в обоих вариантах: она помещается
+            /// в оба хранилища, поэтому достаточно меньшего из размеров
+            template <typename To, typename From>
+            static void copy_bytes(To& to, From const& from, std::size_t index) noexcept {
+              constexpr std::size_t to_size = sizeof(to.storage.data);
+              constexpr std::size_t from_size = sizeof(from.storage.data);
+              std::memcpy(static_cast<void*>(&to.storage.data), static_cast<void const*>(&from.storage.data), to_size < from_size ? to_size : from_size);
+              to.storage.indx = static_cast<decltype(to.storage.indx)>(index);
             }
+        };
+
+    }
+
+    namespace visitor {
+
+        struct storage_base_helper {
 
             template <std::size_t... Is>
             struct visit_agency {
@@ -318,100 +554,131 @@ namespace details {
               };
             };
 
-            template<typename... Fs, typename res_t = std::array<std::common_type_t<std::decay_t<Fs>...>, sizeof...(Fs)>>
-            constexpr static res_t functional_array_factory(Fs&&... fs) {
-                return res_t{{std::forward<Fs>(fs)...}};
-            }
-
-            template<typename F, typename... Vs, std::size_t... Is>
-            constexpr static auto visit_factory(std::index_sequence<Is...>) {
-                return visit_agency<Is...>::template visitor<F, Vs...>::visit;
-            }
-
-            template<int N>
-            struct print_size_as_warning
-            {
-               char operator()() { return N + 256; } //deliberately causing overflow
-            };
-
             /// просто костыль
             template<std::size_t id, typename T>
             struct wrap_pair {
                 constexpr static std::size_t value = id;
             };
 
-            template<std::size_t I, typename F, typename... Vs>
-            constexpr static auto functional_line_factory_impl() {
-                return visit_factory<F, Vs...>(std::index_sequence<wrap_pair<I, Vs>::value...>());
-            }
+        };
 
-            template<typename F, typename... Vs, std::size_t... Is>
-            constexpr static auto functional_line_factory_impl(std::index_sequence<Is...>) {
-                return functional_array_factory(functional_line_factory_impl<Is, F, Vs...>()...);
-            }
+        ////////////////////////////////////////////////////////////////////
+        /// Для себя, если забуду, что тут написано:
+        /// Если мы хотим применить функцию Visitor к Variant'ам (Vs...) с размерами N1, N2, ..., Nk, то
+        /// 1) Сворачиваем индексы в один линейный: i1 * (N2 * ... * Nk) + i2 * (N3 * ... * Nk) + ... + ik
+        ///    (flat_index, "шаги" считаются на этапе компиляции)
+        /// 2) По линейному индексу одним dispatch_index выбираем ячейку плоской таблицы размера N1 * ... * Nk
+        ///    (или case одного switch), координаты ячейки восстанавливаются обратно делением на шаги
+        /// 3) В ячейке вызываем Visitor от активных альтернатив с этими координатами
+        ///
+        /// Если мы хотим применить функцию Visitor к Variantam, активные индексы которых совпадают и мы его знаем (index) то
+        /// 1) Выбираем ячейку по самому index - что-то вроде главной диагонали с координатами 000, 111 и тп
+        ///
 
-            template<typename F, typename V, typename... Vs>
-            constexpr static decltype(auto) functional_line_factory() {
-                static_assert((std::is_same_v<std::integral_constant<std::size_t, std::decay_t<V>::size()>, std::integral_constant<std::size_t, std::decay_t<Vs>::size()>> && ...), "all of the variants must be the same size.");
-                return functional_line_factory_impl<F, V, Vs...>(std::make_index_sequence<std::decay_t<V>::size()>{});
+        template<std::size_t... Ns>
+        struct flat_index {
+            constexpr static std::size_t count = sizeof...(Ns);
+            constexpr static std::size_t sizes[] = {Ns...};
+            constexpr static std::size_t size = (Ns * ... * std::size_t(1));
+
+            constexpr static std::size_t stride(std::size_t k) {
+                std::size_t result = 1;
+                for (std::size_t i = k + 1; i < count; ++i) result *= sizes[i];
+                return result;
             }
 
-            template<typename F, typename... Vs, typename Is>
-            constexpr static auto functional_matrix_factory_impl(Is is) {
-                return visit_factory<F, Vs...>(is);
+            constexpr static std::size_t coordinate(std::size_t linear, std::size_t k) {
+                return linear / stride(k) % sizes[k];
             }
 
-            template<typename F, typename... Vs, std::size_t... Is, std::size_t... IAs, typename... RestIS>
-            constexpr static auto functional_matrix_factory_impl(std::index_sequence<Is...>, std::index_sequence<IAs...>, RestIS... rest) {
-//                print_size_as_warning<sizeof...(RestIS)>()();
-                return functional_array_factory(functional_matrix_factory_impl<F, Vs...>(std::index_sequence<Is..., IAs>{}, rest...)...);
+            template<typename... Is>
+            constexpr static std::size_t linear(Is... indices) {
+                std::size_t result = 0;
+                ((result = result * Ns + indices), ...);
+                return result;
             }
+        };
 
+        ////////////////////////////////////////////////////////////////////
+        /// dispatch_index<N>(index, f) вызывает f(std::integral_constant<std::size_t, index>()).
+        /// Для inline_switch все ветки видны компилятору и visitor инлайнится в место вызова;
+        /// table (и слишком большие N) - вызов через таблицу указателей на функции.
 
-            template<typename F, typename... Vs>
-            constexpr static decltype(auto) functional_matrix_factory() {
-                return functional_matrix_factory_impl<F, Vs...>(std::index_sequence<>(), std::make_index_sequence<std::decay_t<Vs>::size()>{}...);
-            }
+        template<typename F, std::size_t I>
+        constexpr decltype(auto) call_with_index(F&& f) {
+            return std::forward<F>(f)(std::integral_constant<std::size_t, I>());
+        }
 
-        };
+        template<typename F, typename Is>
+        struct index_table;
 
-        template <typename F, typename... Vs>
-        struct functional_line {
-            using type = decltype(storage_base_helper::functional_line_factory<F, Vs...>());
-            static constexpr type value = storage_base_helper::functional_line_factory<F, Vs...>();
+        template<typename F, std::size_t... Is>
+        struct index_table<F, std::index_sequence<Is...>> {
+            using result_t = decltype(call_with_index<F, 0>(std::declval<F>()));
+            static constexpr result_t (*value[])(F&&) = {&call_with_index<F, Is>...};
         };
 
-        /// Создает N-мерную "кубичискую" матрицу, длина "стороны" которой varaint::size()
-        template <typename F, typename... Vs>
-        struct functional_matrix {
-            using type = decltype(storage_base_helper::functional_matrix_factory<F, Vs...>());
-            static constexpr type value = storage_base_helper::functional_matrix_factory<F, Vs...>();
-        };
+#define VR_SWITCH_CASE(I)                                                                       \
+            case I:                                                                             \
+                if constexpr (I < N) {                                                          \
+                    return std::forward<F>(f)(std::integral_constant<std::size_t, I>());        \
+                } else {                                                                        \
+                    break;                                                                      \
+                }
+#define VR_SWITCH_CASES_4(I) VR_SWITCH_CASE(I) VR_SWITCH_CASE(I + 1) VR_SWITCH_CASE(I + 2) VR_SWITCH_CASE(I + 3)
+#define VR_SWITCH_CASES_16(I) VR_SWITCH_CASES_4(I) VR_SWITCH_CASES_4(I + 4) VR_SWITCH_CASES_4(I + 8) VR_SWITCH_CASES_4(I + 12)
+
+        template<std::size_t N, visit_strategy S = visit_strategy::inline_switch, typename F>
+        constexpr decltype(auto) dispatch_index(std::size_t index, F&& f) {
+            if constexpr (S == visit_strategy::table || N > VR_SWITCH_VISIT_MAX) {
+                return index_table<F, std::make_index_sequence<N>>::value[index](std::forward<F>(f));
+            } else if constexpr (N == 1) {
+                return std::forward<F>(f)(std::integral_constant<std::size_t, 0>());
+            } else if constexpr (N == 2) {
+                if (index == 0) return std::forward<F>(f)(std::integral_constant<std::size_t, 0>());
+                return std::forward<F>(f)(std::integral_constant<std::size_t, 1>());
+            } else if constexpr (N == 3) {
+                if (index == 0) return std::forward<F>(f)(std::integral_constant<std::size_t, 0>());
+                if (index == 1) return std::forward<F>(f)(std::integral_constant<std::size_t, 1>());
+                return std::forward<F>(f)(std::integral_constant<std::size_t, 2>());
+            } else {
+                switch (index) {
+                    VR_SWITCH_CASES_16(0)
+                    VR_SWITCH_CASES_16(16)
+                    default:
+                        break;
+                }
+                /// сюда попадает только последняя альтернатива (ее case ведет сюда же через default)
+                return std::forward<F>(f)(std::integral_constant<std::size_t, N - 1>());
+            }
+        }
 
-        ////////////////////////////////////////////////////////////////////
-        /// Для себя, если забуду, что тут написано:
-        /// Если мы хотим применить функцию Visitor к Variant'ам (Vs...), то для этого
-        /// 1) Строим матрицу, в ячейках которых находится функция visit, которая вызовет std::invoke
-        ///    коориданты этой функции - индексы из вариантов, которые предполагаются активированными
-        /// 2) В этой матрице обращаемся к элементу с координатами vs1.index(), vs2.index(), ....,
-        ///    получая таким образому функцию, которую нам нужно вызвать
-        /// 3) Вызываем функцию, передавая ей Visitor и Vs..., что будет равнсильно Visitor(Vs...) // тут форварды всякией
-        ///
-        /// Если мы хотим применить функцию Visitor к Variantam, активные индексы которых совпадают и мы его знаем (index) то
-        /// 1) Строим что-то вроде главной диагонали с координатами 000, 111 и тп
-        /// 2) Аналогично находим нужную ячейку, функцию которой вызовем
-        ///
+#undef VR_SWITCH_CASES_16
+#undef VR_SWITCH_CASES_4
+#undef VR_SWITCH_CASE
 
-        template<typename Visitor, typename... Vs>
+        /// Ячейка плоской таблицы с линейным индексом L
+        template<typename Index, std::size_t L, typename Visitor, typename... Vs, std::size_t... Ks>
+        constexpr decltype(auto) visit_flat_cell(std::index_sequence<Ks...>, Visitor&& visitor, Vs&&... vs) {
+            return storage_base_helper::visit_agency<Index::coordinate(L, Ks)...>
+                                      ::template visitor<Visitor&&, Vs&&...>::visit(std::forward<Visitor>(visitor), std::forward<Vs>(vs)...);
+        }
+
+        template<visit_strategy S = visit_strategy::inline_switch, typename Visitor, typename... Vs>
         constexpr static decltype(auto) visit_alternativeernative_at(std::size_t index, Visitor&& visitor, Vs&&... vs) {
-            return storage_base_helper::at(functional_line<Visitor&&, decltype(std::forward<Vs>(vs))...>::value, index)
-                                         (std::forward<Visitor>(visitor), std::forward<Vs>(vs)...);
+            static_assert(((std::decay_t<get_type_at_t<0, Vs...>>::size() == std::decay_t<Vs>::size()) && ...), "all of the variants must be the same size.");
+            return dispatch_index<std::decay_t<get_type_at_t<0, Vs...>>::size(), S>(index, [&](auto I) -> decltype(auto) {
+                return storage_base_helper::visit_agency<storage_base_helper::wrap_pair<decltype(I)::value, Vs>::value...>
+                                          ::template visitor<Visitor&&, Vs&&...>::visit(std::forward<Visitor>(visitor), std::forward<Vs>(vs)...);
+            });
         }
 
-        template<typename Visitor, typename... Vs>
+        template<visit_strategy S = visit_strategy::inline_switch, typename Visitor, typename... Vs>
         constexpr static decltype(auto) visit_alternative(Visitor&& visitor, Vs&&... vs) {
-            auto x = storage_base_helper::at(functional_matrix<Visitor&&, decltype(std::forward<Vs>(vs))...>::value, vs.index()...);
-            return x(std::forward<Visitor>(visitor), std::forward<Vs>(vs)...);
+            using index_t = flat_index<std::decay_t<Vs>::size()...>;
+            return dispatch_index<index_t::size, S>(index_t::linear(vs.index()...), [&](auto L) -> decltype(auto) {
+                return visit_flat_cell<index_t, decltype(L)::value>(std::index_sequence_for<Vs...>(), std::forward<Visitor>(visitor), std::forward<Vs>(vs)...);
+            });
         }
 
 
@@ -434,8 +701,8 @@ namespace details {
                 template<typename... Alts>
                 constexpr decltype(auto) operator()(Alts&&... alts) const {
                     return variant_functional_object<Visitor,
-                                            decltype((std::forward<Alts>(alts).value))...
-                            >()(std::forward<Visitor>(visitor), std::forward<Alts>(alts).value...);
+                                            decltype(unbox(std::forward<Alts>(alts).value))...
+                            >()(std::forward<Visitor>(visitor), unbox(std::forward<Alts>(alts).value)...);
                 }
             };
 
@@ -445,24 +712,101 @@ namespace details {
             }
 
 
-            template<typename Visitor, typename... Vs>
+            template<visit_strategy S = visit_strategy::inline_switch, typename Visitor, typename... Vs>
             constexpr static decltype(auto) visit_variant_at(std::size_t index, Visitor&& visitor, Vs&&... vs) {
-                return visit_alternativeernative_at(index, std::forward<Visitor>(visitor), std::forward<Vs>(vs).storage...);
+                return visit_alternativeernative_at<S>(index, std::forward<Visitor>(visitor), std::forward<Vs>(vs).storage...);
             }
 
-            template<typename Visitor, typename... Vs>
+            template<visit_strategy S = visit_strategy::inline_switch, typename Visitor, typename... Vs>
             constexpr static decltype(auto) visit_variant(Visitor&& visitor, Vs&&... vs) {
-                return visit_alternative(std::forward<Visitor>(visitor), std::forward<Vs>(vs).storage...);
+                return visit_alternative<S>(std::forward<Visitor>(visitor), std::forward<Vs>(vs).storage...);
             }
 
-            template<typename Visitor, typename... Vs>
+            template<visit_strategy S = visit_strategy::inline_switch, typename Visitor, typename... Vs>
             constexpr static decltype(auto) visit_value_at(std::size_t index, Visitor&& visitor, Vs&&... vs) {
-                return visit_variant_at(index, variant_functional_helper_factory(std::forward<Visitor>(visitor)), std::forward<Vs>(vs)...);
+                return visit_variant_at<S>(index, variant_functional_helper_factory(std::forward<Visitor>(visitor)), std::forward<Vs>(vs)...);
             }
 
-            template<typename Visitor, typename... Vs>
+            template<visit_strategy S = visit_strategy::inline_switch, typename Visitor, typename... Vs>
             constexpr static decltype(auto) visit_value(Visitor&& visitor, Vs&&... vs) {
-                return visit_variant(variant_functional_helper_factory(std::forward<Visitor>(visitor)), std::forward<Vs>(vs)...);
+                return visit_variant<S>(variant_functional_helper_factory(std::forward<Visitor>(visitor)), std::forward<Vs>(vs)...);
+            }
+
+            ////////////////////////////////////////////////////////////////////
+            /// Разреженная таблица: по линейному индексу хранится не функция, а номер объявленного сочетания
+            /// (0 - fallback), так что инстанцируются только объявленные ячейки и один fallback
+
+            template<typename T, typename V>
+            struct alternative_id;
+
+            template<typename T, template<typename...> class V, typename... Ts>
+            struct alternative_id<T, V<Ts...>> {
+                static_assert(has_alternative_v<T, Ts...>, "combination names a type that is not an alternative of the variant");
+                constexpr static std::size_t value = alternative_index_v<T, Ts...>;
+            };
+
+            template<typename Combinations, typename... Vs>
+            struct sparse_table;
+
+            template<typename... Cs, typename... Vs>
+            struct sparse_table<combinations<Cs...>, Vs...> {
+                using index_t = flat_index<std::decay_t<Vs>::size()...>;
+                using slot_t = variant_index_t<sizeof...(Cs) + 1>;
+
+                template<typename... As>
+                constexpr static std::size_t linear(combination<As...>) {
+                    static_assert(sizeof...(As) == sizeof...(Vs), "combination must name one alternative per variant");
+                    return index_t::linear(alternative_id<As, std::decay_t<Vs>>::value...);
+                }
+
+                constexpr static std::array<slot_t, index_t::size> make_slots() {
+                    std::array<slot_t, index_t::size> result{};
+                    std::size_t slot = 0;
+                    ((result[linear(Cs())] = static_cast<slot_t>(++slot)), ...);
+                    return result;
+                }
+
+                constexpr static std::array<slot_t, index_t::size> slots = make_slots();
+
+                template<typename Visitor, typename... As>
+                constexpr static decltype(auto) visit_combination(combination<As...>, Visitor&& visitor, Vs&&... vs) {
+                    return std::invoke(std::forward<Visitor>(visitor),
+                                       access::variant_helper::get_value<alternative_id<As, std::decay_t<Vs>>::value>(std::forward<Vs>(vs))...);
+                }
+
+                template<visit_strategy S, typename Visitor, typename Fallback>
+                constexpr static decltype(auto) visit(Visitor&& visitor, Fallback&& fallback, Vs&&... vs) {
+                    std::size_t slot = (vs.valueless_by_exception() || ...) ? 0 : slots[index_t::linear(vs.index()...)];
+                    return dispatch_index<sizeof...(Cs) + 1, S>(slot, [&](auto I) -> decltype(auto) {
+                        if constexpr (decltype(I)::value == 0) {
+                            return std::invoke(std::forward<Fallback>(fallback), std::forward<Vs>(vs)...);
+                        } else {
+                            return visit_combination(get_type_at_t<decltype(I)::value - 1, Cs...>(), std::forward<Visitor>(visitor), std::forward<Vs>(vs)...);
+                        }
+                    });
+                }
+            };
+
+            ////////////////////////////////////////////////////////////////////
+
+            template<visit_strategy S = visit_strategy::inline_switch, typename Visitor, typename V>
+            constexpr static decltype(auto) visit_likely(likely<>, Visitor&& visitor, V&& v) {
+                return visit_value<S>(std::forward<Visitor>(visitor), std::forward<V>(v));
+            }
+
+            template<visit_strategy S = visit_strategy::inline_switch, typename H, typename... Hs, typename Visitor, typename V>
+            constexpr static decltype(auto) visit_likely(likely<H, Hs...>, Visitor&& visitor, V&& v) {
+                constexpr std::size_t I = alternative_id<H, std::decay_t<V>>::value;
+                if (VR_LIKELY(v.index() == I)) {
+                    return std::invoke(std::forward<Visitor>(visitor), access::variant_helper::get_value<I>(std::forward<V>(v)));
+                }
+                return visit_likely<S>(likely<Hs...>(), std::forward<Visitor>(visitor), std::forward<V>(v));
+            }
+
+            template<visit_strategy S = visit_strategy::inline_switch, typename Visitor, typename Fallback, typename... Vs>
+            constexpr static decltype(auto) visit_sparse(Visitor&& visitor, Fallback&& fallback, Vs&&... vs) {
+                using table_t = sparse_table<typename std::decay_t<Visitor>::combinations, Vs...>;
+                return table_t::template visit<S>(std::forward<Visitor>(visitor), std::forward<Fallback>(fallback), std::forward<Vs>(vs)...);
             }
         };
 
@@ -496,7 +840,7 @@ namespace details {
             alternative& operator =(alternative&&) = default;
             ~alternative() = default;
 
-            T value;
+            VR_NO_UNIQUE_ADDRESS T value;
         };
 
         /////////////////////////////////////////////////////////////////////////////////
@@ -571,11 +915,52 @@ namespace details {
         };
 
         /////////////////////////////////////////////////////////////////////////////////
+        /// Если все альтернативы - пустые тривиальные типы (теги вроде monostate), хранить в них нечего:
+        /// все альтернативы живут одновременно, занимают ноль байт, и от variant остается только индекс
+
+        template<std::size_t ind, typename... Ts>
+        struct empty_storage {};
+
+        template<std::size_t ind, typename T, typename... Ts>
+        struct empty_storage<ind, T, Ts...> {
+
+            constexpr empty_storage() : head(), tail() {}
+
+            template<typename... As>
+            explicit constexpr empty_storage(std::in_place_index_t<0>, As&&... args)
+                : head(std::in_place_t(), std::forward<As>(args)...), tail()
+            {}
+
+            template<std::size_t id, typename... As>
+            explicit constexpr empty_storage(std::in_place_index_t<id>, As&&... args)
+                : head(), tail(std::in_place_index_t<id - 1>(), std::forward<As>(args)...)
+            {}
+
+            friend struct access::union_storage_helper;
+
+        private:
+
+            VR_NO_UNIQUE_ADDRESS alternative<ind, T> head;
+            VR_NO_UNIQUE_ADDRESS empty_storage<ind + 1, Ts...> tail;
+        };
+
+        template<typename T>
+        inline constexpr bool is_tag_type_v = std::is_empty_v<T> && std::is_trivially_default_constructible_v<T> &&
+                                              std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>;
+
+        /////////////////////////////////////////////////////////////////////////////////
+        /// Индекс хранится в наименьшем подходящем типе (unsigned char для <= 255 альтернатив)
+        /// сразу после данных, то есть в байтах выравнивания, которые иначе пропадали бы:
+        /// variant<int, float> занимает 8 байт, а не 16
 
         template<typename... Ts>
         struct storage_base {
 
-            storage_base() : data(), indx(-1) {}
+            using index_type = variant_index_t<sizeof...(Ts)>;
+
+            constexpr static index_type npos_index = std::numeric_limits<index_type>::max();
+
+            storage_base() : data(), indx(npos_index) {}
             storage_base(storage_base const&) = default;
             storage_base(storage_base&&) = default;
 
@@ -590,7 +975,7 @@ namespace details {
             }
 
             constexpr bool valueless_by_exception() const noexcept {
-                    return indx == static_cast<std::size_t>(-1);
+                    return indx == npos_index;
             }
 
             constexpr std::size_t index() const noexcept {
@@ -602,7 +987,9 @@ namespace details {
             ///////////////////https://stackoverflow.com/questions/29391422/declare-static-functions-as-friend-function
 //        protected:
 
-            using data_type = union_storage<(std::is_trivially_destructible_v<Ts> && ...),0, Ts...>;
+            using data_type = std::conditional_t<(is_tag_type_v<Ts> && ...),
+                                                 empty_storage<0, Ts...>,
+                                                 union_storage<(std::is_trivially_destructible_v<Ts> && ...),0, Ts...>>;
 
             friend struct visitor::storage_base_helper;
             friend struct access::storage_base_helper;
@@ -617,8 +1004,98 @@ namespace details {
                 return a;
             }
 
-            data_type data;
-            std::size_t indx;
+            VR_NO_UNIQUE_ADDRESS data_type data;
+            index_type indx;
+        };
+
+        ////////////////////////////////////// Operations table ///////////////////////////////////////////
+        ///  Специальные члены альтернатив: одна таблица на набор Ts..., общая для деструктора, конструкторов,
+        ///  присваиваний и swap (раньше каждый строил свою таблицу из своей лямбды). Функции зависят только от T,
+        ///  поэтому общие еще и у разных наборов с одинаковыми типами. Все альтернативы union_storage лежат
+        ///  по одному адресу, так что функциям достаточно void*.
+        ///  Операции, которых у типа нет, ничего не делают - вызывающий код проверяет это static_assert'ом.
+
+        template<typename T>
+        struct operations_for {
+            static void destroy(void* what) noexcept {
+                static_cast<T*>(what)->~T();
+            }
+
+            static void copy_construct(void* where, void const* what) {
+                if constexpr (std::is_copy_constructible_v<T>) new (where) T(*static_cast<T const*>(what));
+            }
+
+            static void move_construct(void* where, void* what) {
+                if constexpr (std::is_move_constructible_v<T>) new (where) T(std::move(*static_cast<T*>(what)));
+            }
+
+            static void copy_assign(void* where, void const* what) {
+                if constexpr (std::is_copy_assignable_v<T>) *static_cast<T*>(where) = *static_cast<T const*>(what);
+            }
+
+            static void move_assign(void* where, void* what) {
+                if constexpr (std::is_move_assignable_v<T>) *static_cast<T*>(where) = std::move(*static_cast<T*>(what));
+            }
+
+            static void swap(void* lhs, void* rhs) {
+                using std::swap;
+                if constexpr (std::is_swappable_v<T>) swap(*static_cast<T*>(lhs), *static_cast<T*>(rhs));
+            }
+        };
+
+        struct operations_entry {
+            void (*destroy)(void*) noexcept;
+            void (*copy_construct)(void*, void const*);
+            void (*move_construct)(void*, void*);
+            void (*copy_assign)(void*, void const*);
+            void (*move_assign)(void*, void*);
+            void (*swap)(void*, void*);
+            bool nothrow_copy_construct;
+            bool nothrow_move_construct;
+        };
+
+        template<typename T>
+        constexpr operations_entry make_operations_entry() {
+            return {&operations_for<T>::destroy,
+                    &operations_for<T>::copy_construct,
+                    &operations_for<T>::move_construct,
+                    &operations_for<T>::copy_assign,
+                    &operations_for<T>::move_assign,
+                    &operations_for<T>::swap,
+                    std::is_nothrow_copy_constructible_v<T>,
+                    std::is_nothrow_move_constructible_v<T>};
+        }
+
+        /// По биту на альтернативу: проверка свойства активной альтернативы - сдвиг и маска, без косвенного вызова
+        template<std::size_t N>
+        struct alternative_mask {
+            std::uint64_t words[(N + 63) / 64];
+
+            constexpr bool operator[](std::size_t index) const {
+                return (words[index / 64] >> (index % 64)) & 1;
+            }
+        };
+
+        template<bool... Bs>
+        constexpr alternative_mask<sizeof...(Bs)> make_alternative_mask() {
+            alternative_mask<sizeof...(Bs)> mask{};
+            std::size_t index = 0;
+            ((mask.words[index / 64] |= std::uint64_t(Bs) << (index % 64), ++index), ...);
+            return mask;
+        }
+
+        template<typename... Ts>
+        struct operations {
+            constexpr static operations_entry table[] = {make_operations_entry<Ts>()...};
+
+            /// Тривиально копируемые альтернативы копируются и перемещаются memcpy всего хранилища
+            constexpr static bool any_trivially_copyable = (std::is_trivially_copyable_v<Ts> || ...);
+            constexpr static alternative_mask<sizeof...(Ts)> trivially_copyable = make_alternative_mask<std::is_trivially_copyable_v<Ts>...>();
+            constexpr static alternative_mask<sizeof...(Ts)> trivially_destructible = make_alternative_mask<std::is_trivially_destructible_v<Ts>...>();
+            constexpr static alternative_mask<sizeof...(Ts)> nothrow_move_constructible = make_alternative_mask<std::is_nothrow_move_constructible_v<Ts>...>();
+
+            constexpr static bool any_empty_after_move = (is_empty_after_move_v<Ts> || ...);
+            constexpr static alternative_mask<sizeof...(Ts)> empty_after_move = make_alternative_mask<is_empty_after_move_v<Ts>...>();
         };
 
         ////////////////////////////////////// Add destructors ///////////////////////////////////////////
@@ -640,7 +1117,7 @@ namespace details {
             storage_destructor_part& operator =(storage_destructor_part&&) = default;
 
             constexpr void destroy() {
-                this->indx = variant_npos;
+                this->indx = this->npos_index;
             }
 
             ~storage_destructor_part() = default;
@@ -657,11 +1134,11 @@ namespace details {
             storage_destructor_part& operator =(storage_destructor_part const&) = default;
             storage_destructor_part& operator =(storage_destructor_part&&) = default;
 
-            constexpr void destroy() {
-                if (!this->valueless_by_exception()) {
-                    visitor::visit_alternative([](auto& value){using type = std::remove_reference_t<decltype(value)>; value.~type();}, *this);
+            void destroy() {
+                if (!this->valueless_by_exception() && !operations<Ts...>::trivially_destructible[this->indx]) {
+                    operations<Ts...>::table[this->indx].destroy(std::addressof(this->data));
                 }
-                this->indx = variant_npos;
+                this->indx = this->npos_index;
             }
 
             ~storage_destructor_part() {
@@ -688,16 +1165,48 @@ namespace details {
                 return a.value;
             }
 
+            /// prvalue f() строится прямо на месте value (единственного члена альтернативы): инициализация
+            /// [[no_unique_address]] члена из prvalue не гарантирует пропуск перемещения, а placement new - гарантирует
+            template <std::size_t I, typename T, typename F>
+            static T& construct_alternative_with(alternative<I, T>& a, F&& f) {
+                return *::new (static_cast<void*>(std::addressof(a.value))) T(std::forward<F>(f)());
+            }
+
+            /// Копия байтов хранилища: только для тривиально копируемой активной альтернативы
+            template <typename T>
+            static void copy_bytes(storage_constructor_part& where, T const& what) {
+                std::memcpy(static_cast<void*>(std::addressof(where.data)), static_cast<void const*>(std::addressof(what.data)), sizeof(where.data));
+                where.indx = what.indx;
+            }
+
             template <typename T>
             static void construct(storage_constructor_part& where, T&& what) {
                 where.destroy();
+                if constexpr (operations<Ts...>::any_trivially_copyable) {
+                    if (!what.valueless_by_exception() && operations<Ts...>::trivially_copyable[what.indx]) {
+                        copy_bytes(where, what);
+                        return;
+                    }
+                }
                 if (!what.valueless_by_exception()) {
-                    visitor::visit_alternativeernative_at(what.index(),
-                                          [](auto& where_alt, auto&& what_alt) {
-                                              storage_constructor_part::construct_alternative(where_alt, std::forward<decltype(what_alt)>(what_alt).value);
-                                          },
-                                          where, std::forward<T>(what));
+                    operations_entry const& ops = operations<Ts...>::table[what.index()];
+                    if constexpr (std::is_lvalue_reference_v<T>) {
+                        static_assert((std::is_copy_constructible_v<Ts> && ...), "variant can be copied only if all of the alternatives are copy constructible");
+                        ops.copy_construct(std::addressof(where.data), std::addressof(what.data));
+                    } else {
+                        static_assert((std::is_move_constructible_v<Ts> && ...), "variant can be moved only if all of the alternatives are move constructible");
+                        ops.move_construct(std::addressof(where.data), std::addressof(what.data));
+                    }
                     where.indx = what.indx;
+                    if constexpr (!std::is_lvalue_reference_v<T>) forget_moved(what);
+                }
+            }
+
+            /// Из what переместили альтернативу: если она после этого пуста (is_empty_after_move), what - valueless
+            template <typename S>
+            static void forget_moved(S& what) noexcept {
+                if constexpr (operations<Ts...>::any_empty_after_move) {
+                    if (operations<Ts...>::empty_after_move[what.indx]) what.indx = what.npos_index;
                 }
             }
         };
@@ -779,16 +1288,78 @@ namespace details {
             using storage_mconstructor_part<(std::is_trivially_move_constructible_v<Ts> && ...), Ts...>::storage_mconstructor_part;
             using storage_mconstructor_part<(std::is_trivially_move_constructible_v<Ts> && ...), Ts...>::operator =;
 
+            /// Аргументы могут ссылаться на текущее значение: v.emplace<0>(get<1>(v).front()). Если текущая альтернатива
+            /// что-то освобождает при уничтожении или аргумент лежит в самом хранилище, а T переносится без исключений,
+            /// T строится в стороне и старое значение уничтожается после этого (если конструктор бросит, оно останется).
+            /// Иначе T строится сразу на месте без лишнего перемещения; после destroy индекс уже npos, так что при
+            /// исключении хранилище останется пустым. Аргументы неперемещаемого T не должны ссылаться на текущее значение.
             template<std::size_t I, typename... As>
-            decltype(auto) emplace(As... args) {
+            decltype(auto) emplace(As&&... args) {
+                using T = get_type_at_t<I, Ts...>;
+                auto& place = access::storage_base_helper::get_alternative<I>(*this);
+                if constexpr (sizeof...(As) != 0 && (is_trivially_relocatable_v<T> || std::is_nothrow_move_constructible_v<T>)) {
+                    if (may_alias(args...)) {
+                        alignas(T) unsigned char buffer[sizeof(T)];
+                        T* side = ::new (static_cast<void*>(buffer)) T(std::forward<As>(args)...);
+                        this->destroy();
+                        return relocate_alternative(place, side);
+                    }
+                }
                 this->destroy();
-                try {
-                    return this->indx = I,
-                       this->construct_alternative(access::storage_base_helper::get_alternative<I>(*this), std::forward<As>(args)...);
-                } catch (...) {
-                    this->indx = variant_npos;
-                    throw;
+                auto& value = this->construct_alternative(place, std::forward<As>(args)...);
+                this->indx = I;
+                return value;
+            }
+
+            /// Альтернатива I из prvalue f(). Если f может бросить, а результат можно перенести без исключений
+            /// (побайтно или nothrow move), он строится в стороне и старое значение уничтожается только после
+            /// успеха; иначе - сразу на месте (при исключении хранилище пустое)
+            template<std::size_t I, typename F>
+            decltype(auto) emplace_with(F&& f) {
+                using T = get_type_at_t<I, Ts...>;
+                auto& place = access::storage_base_helper::get_alternative<I>(*this);
+                if constexpr (std::is_nothrow_invocable_v<F> ||
+                              !(is_trivially_relocatable_v<T> || std::is_nothrow_move_constructible_v<T>)) {
+                    this->destroy();
+                    auto& value = this->construct_alternative_with(place, std::forward<F>(f));
+                    this->indx = I;
+                    return value;
+                } else {
+                    alignas(T) unsigned char buffer[sizeof(T)];
+                    T* side = ::new (static_cast<void*>(buffer)) T(std::forward<F>(f)());
+                    this->destroy();
+                    return relocate_alternative(place, side);
+                }
+            }
+
+            /// Переносит построенное в стороне значение в пустое хранилище альтернативой I
+            template<std::size_t I, typename T>
+            T& relocate_alternative(alternative<I, T>& place, T* side) noexcept {
+                if constexpr (is_trivially_relocatable_v<T>) {
+                    std::memcpy(static_cast<void*>(std::addressof(place.value)), static_cast<void const*>(side), sizeof(T));
+                } else {
+                    this->construct_alternative(place, std::move(*side));
+                    side->~T();
+                }
+                this->indx = I;
+                return place.value;
+            }
+
+            /// Может ли уничтожение текущего значения испортить аргументы: оно что-то освобождает
+            /// или какой-то аргумент лежит в байтах хранилища
+            template<typename... As>
+            bool may_alias(As const&... args) const noexcept {
+                if constexpr (!(std::is_trivially_destructible_v<Ts> && ...)) {
+                    constexpr static bool trivial[] = {std::is_trivially_destructible_v<Ts>...};
+                    if (!this->valueless_by_exception() && !trivial[this->indx]) return true;
                 }
+                char const* begin = reinterpret_cast<char const*>(this);
+                char const* end = begin + sizeof(*this);
+                auto inside = [&](auto const& arg) {
+                    char const* p = reinterpret_cast<char const*>(std::addressof(arg));
+                    return std::less<char const*>()(p, end) && std::less<char const*>()(begin, p + sizeof(arg));
+                };
+                return (inside(args) || ...);
             }
 
             template<std::size_t I, typename T, typename A>
@@ -796,32 +1367,71 @@ namespace details {
                 if (this->indx == I) {
                     a.value = std::forward<A>(arg);
                 } else {
-                    this->indx = variant_npos;
-                    try {
+                    VR_TRY {
                         if constexpr (std::is_nothrow_constructible_v<T, A> ||
                                       !std::is_nothrow_move_constructible_v<T>) {
                             this->emplace<I>(std::forward<A>(arg));
                         } else {
                             this->emplace<I>(T(std::forward<A>(arg)));
                         }
-                    } catch (...) {
-                        this->indx = variant_npos;
-                        throw;
+                    } VR_CATCH_ALL {
+                        this->indx = this->npos_index;
+                        VR_RETHROW;
                     }
                 }
             }
 
+            /// То же, что assign_alternative, но через таблицу операций: тип правой части известен только в runtime
             template<typename T>
             void assign(T&& rhs) {
+                /// самоприсваивание: быстрый путь ниже скопировал бы в себя индекс npos, выставленный destroy()
+                if (static_cast<void const*>(this) == static_cast<void const*>(std::addressof(rhs))) return ;
                 if (this->valueless_by_exception() && rhs.valueless_by_exception()) return ;
                 if (rhs.valueless_by_exception()) {
                     this->destroy();
                     return ;
                 }
-                visitor::visit_alternativeernative_at(rhs.index(),
-                                      [this](auto& rhs, auto&& lhs) {
-                                          this->assign_alternative(rhs, std::forward<decltype(lhs)>(lhs).value);
-                                      }, *this, std::forward<T>(rhs));
+                if constexpr (operations<Ts...>::any_trivially_copyable) {
+                    if (operations<Ts...>::trivially_copyable[rhs.indx]) {
+                        this->destroy();
+                        this->copy_bytes(*this, rhs);
+                        return ;
+                    }
+                }
+                operations_entry const& ops = operations<Ts...>::table[rhs.index()];
+                void* where = std::addressof(this->data);
+                if constexpr (std::is_lvalue_reference_v<T>) {
+                    static_assert(((std::is_copy_constructible_v<Ts> && std::is_copy_assignable_v<Ts>) && ...),
+                                  "variant can be copy assigned only if all of the alternatives are copy constructible and copy assignable");
+                    void const* what = std::addressof(rhs.data);
+                    if (this->indx == rhs.indx) {
+                        ops.copy_assign(where, what);
+                    } else if (ops.nothrow_copy_construct || !ops.nothrow_move_construct) {
+                        this->destroy();
+                        ops.copy_construct(where, what);
+                        this->indx = rhs.indx;
+                    } else {
+                        /// копия в стороне: если она бросит исключение, старое значение останется на месте
+                        alignas(typename storage_base<Ts...>::data_type) unsigned char buffer[sizeof(typename storage_base<Ts...>::data_type)];
+                        ops.copy_construct(buffer, what);
+                        this->destroy();
+                        ops.move_construct(where, buffer);
+                        ops.destroy(buffer);
+                        this->indx = rhs.indx;
+                    }
+                } else {
+                    static_assert(((std::is_move_constructible_v<Ts> && std::is_move_assignable_v<Ts>) && ...),
+                                  "variant can be move assigned only if all of the alternatives are move constructible and move assignable");
+                    void* what = std::addressof(rhs.data);
+                    if (this->indx == rhs.indx) {
+                        ops.move_assign(where, what);
+                    } else {
+                        this->destroy();
+                        ops.move_construct(where, what);
+                        this->indx = rhs.indx;
+                    }
+                    this->forget_moved(rhs);
+                }
             }
         };
 
@@ -916,29 +1526,42 @@ namespace details {
             storage_t& operator =(storage_t const&) = default;
             storage_t& operator =(storage_t&&) = default;
 
+            /// Обмен байтами, включая индекс: только если все альтернативы is_trivially_relocatable
+            static void swap_bytes(storage_t& lhs, storage_t& rhs) noexcept {
+                    alignas(storage_t) unsigned char buffer[sizeof(storage_t)];
+                    std::memcpy(buffer, static_cast<void*>(&lhs), sizeof(storage_t));
+                    std::memcpy(static_cast<void*>(&lhs), static_cast<void*>(&rhs), sizeof(storage_t));
+                    std::memcpy(static_cast<void*>(&rhs), buffer, sizeof(storage_t));
+            }
+
             inline void swap(storage_t &other) {
-                    if (this->valueless_by_exception() && other.valueless_by_exception()) {
+                    auto nothrow_movable = [](storage_t const& s) {
+                        return s.valueless_by_exception() || operations<Ts...>::nothrow_move_constructible[s.indx];
+                    };
+
+                    if constexpr ((is_trivially_relocatable_v<Ts> && ...)) {
+                      swap_bytes(*this, other);
+                    } else if (this->valueless_by_exception() && other.valueless_by_exception()) {
                       // do nothing.
                     } else if (this->index() == other.index()) {
-                      visitor::visit_alternativeernative_at(this->index(), [](auto &a, auto &b) { std::swap(a.value,b.value); }, *this, other);
+                      operations<Ts...>::table[this->index()].swap(std::addressof(this->data), std::addressof(other.data));
                     } else {
                       storage_t *lhs = this;
                       storage_t *rhs = &other;
 
-                      if ((lhs->valueless_by_exception() || std::array<bool, sizeof...(Ts)>{{std::is_nothrow_move_constructible<Ts>::value...}}[lhs->index()]) &&
-                          !(rhs->valueless_by_exception() || std::array<bool, sizeof...(Ts)>{{std::is_nothrow_move_constructible<Ts>::value...}}[rhs->index()])) {
+                      if (nothrow_movable(*lhs) && !nothrow_movable(*rhs)) {
                             std::swap(lhs, rhs);
                       }
 
                       storage_t tmp(std::move(*rhs));
 
-                      try {
+                      VR_TRY {
                         this->construct(*rhs, std::move(*lhs));
-                      } catch (...) {
-                          if (tmp.valueless_by_exception() || std::array<bool, sizeof...(Ts)>{{std::is_nothrow_move_constructible<Ts>::value...}}[tmp.index()]) {
+                      } VR_CATCH_ALL {
+                          if (nothrow_movable(tmp)) {
                               this->construct(*rhs, std::move(tmp));
                           }
-                          throw;
+                          VR_RETHROW;
                       }
 
                       this->construct(*lhs, std::move(tmp));
@@ -952,9 +1575,37 @@ namespace details {
 
 /////////////////////////////////////////////////////// Non-member functions //////////////////////////////////////////////////////////////////////////
 
+/// Если какой-то вариант valueless_by_exception - bad_variant_access
 template <class Visitor, class... Variants>
 constexpr decltype(auto) visit(Visitor&& vis, Variants&&... vars) {
-    return details::visitor::variant_helper::visit_value(std::forward<Visitor>(vis), std::forward<Variants>(vars)...);
+    if ((vars.valueless_by_exception() || ...)) details::throw_bad_variant_access();
+    if constexpr (sizeof...(Variants) == 1) {
+        return details::visitor::variant_helper::visit_likely(typename hot_alternatives<std::decay_t<Variants>...>::type(),
+                                                              std::forward<Visitor>(vis), std::forward<Variants>(vars)...);
+    } else {
+        return details::visitor::variant_helper::visit_value(std::forward<Visitor>(vis), std::forward<Variants>(vars)...);
+    }
+}
+
+/// visit с явно заданной стратегией диспетчеризации, например visit_with<visit_strategy::table>(f, v)
+template <visit_strategy S, class Visitor, class... Variants>
+constexpr decltype(auto) visit_with(Visitor&& vis, Variants&&... vars) {
+    if ((vars.valueless_by_exception() || ...)) details::throw_bad_variant_access();
+    return details::visitor::variant_helper::visit_value<S>(std::forward<Visitor>(vis), std::forward<Variants>(vars)...);
+}
+
+/// visit, который сначала проверяет альтернативы Hot... (в этом порядке), а потом диспетчеризует как обычно
+template <class... Hot, class Visitor, class Variant>
+constexpr decltype(auto) visit_likely(Visitor&& vis, Variant&& var) {
+    if (var.valueless_by_exception()) details::throw_bad_variant_access();
+    return details::visitor::variant_helper::visit_likely(likely<Hot...>(), std::forward<Visitor>(vis), std::forward<Variant>(var));
+}
+
+/// visit только по сочетаниям альтернатив из Visitor::combinations; для всех остальных
+/// (и если какой-то вариант valueless_by_exception) вызывается fallback(vars...)
+template <class Visitor, class Fallback, class... Variants>
+constexpr decltype(auto) visit_sparse(Visitor&& vis, Fallback&& fallback, Variants&&... vars) {
+    return details::visitor::variant_helper::visit_sparse(std::forward<Visitor>(vis), std::forward<Fallback>(fallback), std::forward<Variants>(vars)...);
 }
 
 
@@ -962,66 +1613,66 @@ constexpr decltype(auto) visit(Visitor&& vis, Variants&&... vars) {
 
 template <typename T, typename... Ts>
 constexpr bool holds_alternative(variant<Ts...> const& v) noexcept {
-    return details::get_id_at_v<T, Ts...> == v.index() ;
+    return details::alternative_index_v<T, Ts...> == v.index() ;
 }
 
 /////////////////////////////////////////////////////////////////////////
 
 
 template <std::size_t I, class... Types>
-constexpr variant_alternative_t<I, variant<Types...>>& get(variant<Types...>& v) {
+constexpr details::unboxed_t<variant_alternative_t<I, variant<Types...>>>& get(variant<Types...>& v) {
     if (v.index() == I)
-        return details::access::variant_helper::get_alternative<I>(v).value;
+        return details::access::variant_helper::get_value<I>(v);
     else
-        throw bad_variant_access();
+        details::throw_bad_variant_access();
 }
 
 template <std::size_t I, class... Types>
-constexpr variant_alternative_t<I, variant<Types...>>&& get(variant<Types...>&& v) {
+constexpr details::unboxed_t<variant_alternative_t<I, variant<Types...>>>&& get(variant<Types...>&& v) {
     if (v.index() == I)
-        return details::access::variant_helper::get_alternative<I>(std::move(v)).value;
+        return details::access::variant_helper::get_value<I>(std::move(v));
     else
-        throw bad_variant_access();
+        details::throw_bad_variant_access();
 }
 
 template <std::size_t I, class... Types>
-constexpr variant_alternative_t<I, variant<Types...>> const& get(variant<Types...> const& v) {
+constexpr details::unboxed_t<variant_alternative_t<I, variant<Types...>>> const& get(variant<Types...> const& v) {
     if (v.index() == I)
-        return details::access::variant_helper::get_alternative<I>(v).value;
+        return details::access::variant_helper::get_value<I>(v);
     else
-        throw bad_variant_access();
+        details::throw_bad_variant_access();
 }
 
 template <std::size_t I, class... Types>
-constexpr variant_alternative_t<I, variant<Types...>> const&& get(variant<Types...> const&& v) {
+constexpr details::unboxed_t<variant_alternative_t<I, variant<Types...>>> const&& get(variant<Types...> const&& v) {
     if (v.index() == I)
-        return details::access::variant_helper::get_alternative<I>(std::move<variant<Types...>>(v)).value;
+        return details::access::variant_helper::get_value<I>(std::move<variant<Types...>>(v));
     else
-        throw bad_variant_access();
+        details::throw_bad_variant_access();
 }
 
 ///
 
-template <class T, class... Types, std::size_t I = details::get_id_at_v<T, Types...>>
+template <class T, class... Types, std::size_t I = details::alternative_index_v<T, Types...>>
 constexpr T& get(variant<Types...>& v) {
 //    std::cout << I << std::endl;
     return get<I>(v);
 //    return details::access::variant_helper::get_alternative<I>(v).value;
 }
 
-template <class T, class... Types, std::size_t I = details::get_id_at_v<T, Types...>>
+template <class T, class... Types, std::size_t I = details::alternative_index_v<T, Types...>>
 constexpr T&& get(variant<Types...>&& v) {
     return get<I>(std::move(v));
 //    return details::access::variant_helper::get_alternative<I>(std::move(v)).value;
 }
 
-template <class T, class... Types, std::size_t I = details::get_id_at_v<T, Types...>>
+template <class T, class... Types, std::size_t I = details::alternative_index_v<T, Types...>>
 constexpr const T& get(variant<Types...> const& v) {
     return get<I>(v);
 //    return details::access::variant_helper::get_alternative<I>(v).value;
 }
 
-template <class T, class... Types, std::size_t I = details::get_id_at_v<T, Types...>>
+template <class T, class... Types, std::size_t I = details::alternative_index_v<T, Types...>>
 constexpr const T&& get(variant<Types...> const&& v) {
     return get<I>(std::move(v));
 //    return details::access::variant_helper::get_alternative<I>(std::move<variant<Types...>>(v)).value;
@@ -1031,57 +1682,115 @@ constexpr const T&& get(variant<Types...> const&& v) {
 /////////////////////////////////////////////////////////////////////////
 
 template <std::size_t I, class... Types>
-constexpr std::add_pointer_t<variant_alternative_t<I, variant<Types...>>> get_if(variant<Types...>* pv) noexcept {
+constexpr std::add_pointer_t<details::unboxed_t<variant_alternative_t<I, variant<Types...>>>> get_if(variant<Types...>* pv) noexcept {
     if (!pv) return nullptr;
     if (pv->index() == I) {
-        return &details::access::variant_helper::get_alternative<I>(*pv).value;
+        return &details::access::variant_helper::get_value<I>(*pv);
     } else
         return nullptr;
 }
 
 template <std::size_t I, class... Types>
-constexpr std::add_pointer_t<const variant_alternative_t<I, variant<Types...>>> get_if(const variant<Types...>* pv) noexcept {
+constexpr std::add_pointer_t<const details::unboxed_t<variant_alternative_t<I, variant<Types...>>>> get_if(const variant<Types...>* pv) noexcept {
     if (!pv) return nullptr;
     if (pv->index() == I) {
-        return &details::access::variant_helper::get_alternative<I>(*pv).value;
+        return &details::access::variant_helper::get_value<I>(*pv);
     } else
         return nullptr;
 }
 
 template <class T, class... Types>
 constexpr std::add_pointer_t<T> get_if(variant<Types...>* pv) noexcept {
-    constexpr std::size_t I = details::get_id_at_v<T, Types...>;
+    constexpr std::size_t I = details::alternative_index_v<T, Types...>;
     if (!pv) return nullptr;
     if (pv->index() == I) {
-        return &details::access::variant_helper::get_alternative<I>(*pv).value;
+        return &details::access::variant_helper::get_value<I>(*pv);
     } else
         return nullptr;
 }
 
 template <class T, class... Types>
 constexpr std::add_pointer_t<const T> get_if(const variant<Types...>* pv) noexcept {
-    constexpr std::size_t I = details::get_id_at_v<T, Types...>;
+    constexpr std::size_t I = details::alternative_index_v<T, Types...>;
     if (!pv) return nullptr;
     if (pv->index() == I) {
-        return &details::access::variant_helper::get_alternative<I>(*pv).value;
+        return &details::access::variant_helper::get_value<I>(*pv);
     } else
         return nullptr;
 }
 
+/////////////////////////////////////////////////////////////////////////
+///     Доступ без исключений: try_get - указатель или nullptr (как get_if, но от ссылки),
+///     get_unchecked - альтернатива без проверки индекса (в отладочной сборке - assert)
+
+template <std::size_t I, class V, std::size_t N = variant_size<std::decay_t<V>>::value, std::enable_if_t<(I < N)>* = nullptr>
+constexpr auto try_get(V& v) noexcept -> decltype(&details::access::variant_helper::get_value<I>(v)) {
+    if (v.index() == I)
+        return &details::access::variant_helper::get_value<I>(v);
+    return nullptr;
+}
+
+template <class T, template<class...> class V, class... Types>
+constexpr std::add_pointer_t<T> try_get(V<Types...>& v) noexcept {
+    return try_get<details::alternative_index_v<T, Types...>>(v);
+}
+
+template <class T, template<class...> class V, class... Types>
+constexpr std::add_pointer_t<const T> try_get(V<Types...> const& v) noexcept {
+    return try_get<details::alternative_index_v<T, Types...>>(v);
+}
+
+template <std::size_t I, class V, std::size_t N = variant_size<std::decay_t<V>>::value, std::enable_if_t<(I < N)>* = nullptr>
+constexpr decltype(auto) get_unchecked(V&& v) noexcept {
+    assert(v.index() == I && "get_unchecked: wrong alternative");
+    return details::access::variant_helper::get_value<I>(std::forward<V>(v));
+}
+
+template <class T, template<class...> class V, class... Types>
+constexpr T& get_unchecked(V<Types...>& v) noexcept {
+    return get_unchecked<details::alternative_index_v<T, Types...>>(v);
+}
+
+template <class T, template<class...> class V, class... Types>
+constexpr T const& get_unchecked(V<Types...> const& v) noexcept {
+    return get_unchecked<details::alternative_index_v<T, Types...>>(v);
+}
+
+template <class T, template<class...> class V, class... Types>
+constexpr T&& get_unchecked(V<Types...>&& v) noexcept {
+    return get_unchecked<details::alternative_index_v<T, Types...>>(std::move(v));
+}
+
 //////////////////////////////////////////////////////////////////////////////////////
 
+/// Сравнения: разные индексы (и valueless_by_exception) решаются сравнением индексов, одинаковые -
+/// одной диспетчеризацией по общему индексу, которая сравнивает альтернативы как есть
+
+namespace details {
+
+    namespace compare {
+
+        template<typename Op, typename... Types>
+        constexpr bool same_index(Op op, variant<Types...> const& v, variant<Types...> const& w) {
+            return visitor::variant_helper::visit_value_at(v.index(), op, v, w);
+        }
+
+    } // end compare
+
+} // details end
+
 template <class... Types>
 constexpr bool operator==(const variant<Types...>& v, const variant<Types...>& w) {
-    if (v.index()!= w.index()) return false;
+    if (v.index() != w.index()) return false;
     if (v.valueless_by_exception()) return true;
-    return get<v.index()>(v) == get<v.index()>(w);
+    return details::compare::same_index(std::equal_to<>(), v, w);
 }
 
 template <class... Types>
 constexpr bool operator!=(const variant<Types...>& v, const variant<Types...>& w) {
     if (v.index() != w.index()) return true;
     if (v.valueless_by_exception()) return false;
-    return get<v.index()>(v) != get<v.index()>(w);
+    return details::compare::same_index(std::not_equal_to<>(), v, w);
 }
 
 template <class... Types>
@@ -1090,16 +1799,16 @@ constexpr bool operator<(const variant<Types...>& v, const variant<Types...>& w)
     if (v.valueless_by_exception()) return true;
     if (v.index() < w.index()) return true;
     if (v.index() > w.index()) return false;
-    return std::get<v.index()>(v) < std::get<v.index()>(w);
+    return details::compare::same_index(std::less<>(), v, w);
 }
 
 template <class... Types>
 constexpr bool operator>(const variant<Types...>& v, const variant<Types...>& w) {
-    if (v.valueless_by_exception()) return true;
-    if (w.valueless_by_exception()) return false;
+    if (v.valueless_by_exception()) return false;
+    if (w.valueless_by_exception()) return true;
     if (v.index() < w.index()) return false;
     if (v.index() > w.index()) return true;
-    return std::get<v.index()>(v) > std::get<v.index()>(w);
+    return details::compare::same_index(std::greater<>(), v, w);
 }
 
 template <class... Types>
@@ -1108,7 +1817,7 @@ constexpr bool operator<=(const variant<Types...>& v, const variant<Types...>& w
     if (w.valueless_by_exception()) return false;
     if (v.index() < w.index()) return true;
     if (v.index() > w.index()) return false;
-    return get<v.index()>(v) <= get<v.index()>(w);
+    return details::compare::same_index(std::less_equal<>(), v, w);
 }
 
 template <class... Types>
@@ -1117,9 +1826,57 @@ constexpr bool operator>=(const variant<Types...>& v, const variant<Types...>& w
     if (v.valueless_by_exception()) return false;
     if (v.index() > w.index()) return true;
     if (v.index() < w.index()) return false;
-    return get<v.index()>(v) >= get<v.index()>(w);
+    return details::compare::same_index(std::greater_equal<>(), v, w);
 }
 
+#if VR_HAS_THREE_WAY_COMPARISON
+
+template <class... Types>
+constexpr std::common_comparison_category_t<std::compare_three_way_result_t<details::unboxed_t<Types>>...>
+operator<=>(const variant<Types...>& v, const variant<Types...>& w) {
+    if (v.valueless_by_exception() && w.valueless_by_exception()) return std::strong_ordering::equal;
+    if (v.valueless_by_exception()) return std::strong_ordering::less;
+    if (w.valueless_by_exception()) return std::strong_ordering::greater;
+    if (v.index() != w.index()) return v.index() <=> w.index();
+    return details::visitor::variant_helper::visit_value_at(v.index(), [](auto const& a, auto const& b)
+        -> std::common_comparison_category_t<std::compare_three_way_result_t<details::unboxed_t<Types>>...> {
+        return a <=> b;
+    }, v, w);
+}
+
+#endif
+
+/////////////////////////////////////////////////////////////////////////
+///     Сравнение с значением альтернативы T без построения variant: v == t, только если v хранит T.
+///     Порядок тот же, что у v и variant(t) (другой индекс - по индексу, valueless меньше всех)
+
+#define VR_MIXED_COMPARISON(OP, DIFFERENT_LEFT, DIFFERENT_RIGHT)                                                     \
+template <class T, class... Types,                                                                                  \
+          std::enable_if_t<details::has_alternative_v<T, Types...>>* = nullptr,                                      \
+          std::size_t I = details::alternative_index_v<T, Types...>>                                                 \
+constexpr bool operator OP(const variant<Types...>& v, const T& t) {                                                \
+    if (v.index() != I) return (v.index() + 1) DIFFERENT_LEFT (I + 1);                                               \
+    return details::access::variant_helper::get_value<I>(v) OP t;                                                    \
+}                                                                                                                    \
+                                                                                                                     \
+template <class T, class... Types,                                                                                  \
+          std::enable_if_t<details::has_alternative_v<T, Types...>>* = nullptr,                                      \
+          std::size_t I = details::alternative_index_v<T, Types...>>                                                 \
+constexpr bool operator OP(const T& t, const variant<Types...>& v) {                                                \
+    if (v.index() != I) return (I + 1) DIFFERENT_RIGHT (v.index() + 1);                                              \
+    return t OP details::access::variant_helper::get_value<I>(v);                                                    \
+}
+
+/// variant_npos + 1 == 0: valueless меньше любого индекса
+VR_MIXED_COMPARISON(==, ==, ==)
+VR_MIXED_COMPARISON(!=, !=, !=)
+VR_MIXED_COMPARISON(<, <, <)
+VR_MIXED_COMPARISON(>, >, >)
+VR_MIXED_COMPARISON(<=, <, <)
+VR_MIXED_COMPARISON(>=, >, >)
+
+#undef VR_MIXED_COMPARISON
+
 //////////////////////////////////////////////////////////////
 
 template <class... Types>
@@ -1127,6 +1884,408 @@ void swap(variant<Types...>& lhs, variant<Types...>& rhs) noexcept(noexcept(lhs.
     lhs.swap(rhs);
 }
 
+//////////////////////////////////////////////////////////////
+
+/// Переносит [first, last) в неинициализированную память dest (диапазоны могут перекрываться):
+/// после вызова в dest живые объекты, а исходные уничтожены. Возвращает конец перенесенного диапазона.
+/// Если все альтернативы is_trivially_relocatable - один memmove, иначе move + destroy по элементу.
+template <class... Types>
+variant<Types...>* uninitialized_relocate(variant<Types...>* first, variant<Types...>* last, variant<Types...>* dest) {
+    std::size_t n = static_cast<std::size_t>(last - first);
+    if constexpr (is_trivially_relocatable_v<variant<Types...>>) {
+        if (n) std::memmove(static_cast<void*>(dest), static_cast<void const*>(first), n * sizeof(variant<Types...>));
+        return dest + n;
+    } else {
+        static_assert((std::is_nothrow_move_constructible_v<Types> && ...),
+                      "relocation of a variant needs nothrow move constructible or trivially relocatable alternatives");
+        if (dest <= first) {
+            for (std::size_t i = 0; i < n; ++i) {
+                new (dest + i) variant<Types...>(std::move(first[i]));
+                first[i].~variant();
+            }
+        } else {
+            for (std::size_t i = n; i-- > 0;) {
+                new (dest + i) variant<Types...>(std::move(first[i]));
+                first[i].~variant();
+            }
+        }
+        return dest + n;
+    }
+}
+
+/// vector::erase, который сдвигает хвост одним memmove вместо поэлементного перемещающего присваивания.
+/// Освободившиеся в конце копии байтов помечаются valueless, и vector уничтожает их без вызова деструкторов альтернатив.
+template <class... Types, class Allocator>
+typename std::vector<variant<Types...>, Allocator>::iterator
+relocate_erase(std::vector<variant<Types...>, Allocator>& v,
+               typename std::vector<variant<Types...>, Allocator>::const_iterator first,
+               typename std::vector<variant<Types...>, Allocator>::const_iterator last) {
+    if constexpr (is_trivially_relocatable_v<variant<Types...>>) {
+        std::size_t from = static_cast<std::size_t>(first - v.cbegin());
+        std::size_t count = static_cast<std::size_t>(last - first);
+        if (count == 0) return v.begin() + from;
+        variant<Types...>* data = v.data();
+        for (std::size_t i = from; i < from + count; ++i) {
+            data[i].~variant();
+        }
+        uninitialized_relocate(data + from + count, data + v.size(), data + from);
+        for (std::size_t i = v.size() - count; i < v.size(); ++i) {
+            details::access::variant_helper::forget(data[i]);
+        }
+        v.erase(v.end() - count, v.end());
+        return v.begin() + from;
+    } else {
+        return v.erase(first, last);
+    }
+}
+
+template <class... Types, class Allocator>
+typename std::vector<variant<Types...>, Allocator>::iterator
+relocate_erase(std::vector<variant<Types...>, Allocator>& v, typename std::vector<variant<Types...>, Allocator>::const_iterator pos) {
+    return relocate_erase(v, pos, pos + 1);
+}
+
+//////////////////////////////////////////////////////////////
+
+namespace details {
+
+    namespace cast {
+
+        template<typename F, typename... Ts>
+        inline constexpr bool contains_v = (std::is_same_v<F, Ts> || ...);
+
+        /// Для каждой альтернативы From - номер альтернативы того же типа в To (первой) или variant_npos
+        template<typename From, typename To>
+        struct index_map;
+
+        template<typename... Fs, typename... Ts>
+        struct index_map<variant<Fs...>, variant<Ts...>> {
+            constexpr static std::size_t value[] = {(contains_v<Fs, Ts...> ? get_id_at<Fs, Ts...>::value : variant_npos)...};
+
+            /// Любое значение From есть в To: приведение не может не получиться
+            constexpr static bool total = (contains_v<Fs, Ts...> && ...);
+
+            /// Значение переносится копированием байтов хранилища и пересчетом индекса по таблице, без диспетчеризации
+            constexpr static bool bytewise = (std::is_trivially_copyable_v<Fs> && ...);
+        };
+
+        template<typename From, typename To>
+        using result_t = std::conditional_t<index_map<From, To>::total, To, std::optional<To>>;
+
+        template<typename To, typename From>
+        To copy_bytes(From const& from, std::size_t index) {
+            To to = access::variant_helper::make_valueless<To>();
+            access::variant_helper::copy_bytes(to, from, index);
+            return to;
+        }
+
+    } // end cast
+
+} // details end
+
+/// Приведение к варианту с другим набором альтернатив: расширение (variant<int, double> -> variant<int, double, std::string>),
+/// сужение и перестановка. Альтернатива переходит в альтернативу того же типа по таблице индексов, построенной
+/// при компиляции. Если каждая альтернатива From есть в To, результат - To, иначе std::optional<To>
+/// (std::nullopt, если активной альтернативы в To нет). valueless_by_exception вариант дает такой же To.
+/// Когда все альтернативы From тривиально копируемы, значение переносится memcpy без visit.
+template <class To, class From, class Map = details::cast::index_map<std::decay_t<From>, To>>
+details::cast::result_t<std::decay_t<From>, To> variant_cast(From&& from) {
+    using result_t = details::cast::result_t<std::decay_t<From>, To>;
+    if (from.valueless_by_exception()) {
+        return details::access::variant_helper::make_valueless<To>();
+    }
+    if constexpr (Map::bytewise) {
+        std::size_t index = Map::value[from.index()];
+        if constexpr (!Map::total) {
+            if (index == variant_npos) return std::nullopt;
+        }
+        return details::cast::copy_bytes<To>(from, index);
+    } else {
+        return details::visitor::dispatch_index<std::decay_t<From>::size()>(from.index(), [&](auto I) -> result_t {
+            constexpr std::size_t J = Map::value[decltype(I)::value];
+            if constexpr (J == variant_npos) {
+                return std::nullopt;
+            } else if constexpr (Map::total) {
+                return To(std::in_place_index<J>, details::access::variant_helper::get_alternative<decltype(I)::value>(std::forward<From>(from)).value);
+            } else {
+                return result_t(std::in_place, std::in_place_index<J>,
+                                details::access::variant_helper::get_alternative<decltype(I)::value>(std::forward<From>(from)).value);
+            }
+        });
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+///     Хеширование: индекс смешивается с хешем активной альтернативы, одна диспетчеризация.
+///     Строковые альтернативы хешируются как std::string_view, поэтому hash и equal_to прозрачны: unordered контейнер
+///     с ключом variant<int, std::string> можно спрашивать по int, std::string_view или const char*, не строя variant
+///     (heterogeneous lookup у unordered контейнеров есть с C++20). Ключ K сравнивается с альтернативой K, а если ее нет -
+///     с первой альтернативой, у которой тот же key_t (все строковые типы - std::string_view).
+
+namespace details {
+
+    namespace hashing {
+
+        template<typename T>
+        struct key {
+            using type = T;
+        };
+
+        template<typename C, typename Tr, typename A>
+        struct key<std::basic_string<C, Tr, A>> {
+            using type = std::basic_string_view<C, Tr>;
+        };
+
+        template<typename T>
+        using key_t = typename key<std::remove_cv_t<T>>::type;
+
+        /// C-строка как ключ поиска - string_view, т.е. находит только строковую альтернативу. Альтернатива
+        /// char const* - указатель: хешируется и сравнивается по адресу, как в operator==
+        template<typename K>
+        struct lookup_key {
+            using type = key_t<K>;
+        };
+
+        template<>
+        struct lookup_key<char const*> {
+            using type = std::string_view;
+        };
+
+        template<>
+        struct lookup_key<char*> {
+            using type = std::string_view;
+        };
+
+        template<std::size_t N>
+        struct lookup_key<char[N]> {
+            using type = std::string_view;
+        };
+
+        template<typename K>
+        using lookup_key_t = typename lookup_key<std::remove_cv_t<K>>::type;
+
+        /// Тип, в котором ключ K хешируется и сравнивается с альтернативой A
+        template<typename K, typename A>
+        using common_key_t = std::conditional_t<std::is_same_v<K, A>, key_t<A>, lookup_key_t<K>>;
+
+        template<typename K, typename... Ts>
+        constexpr std::size_t lookup_index() {
+            if constexpr (has_alternative_v<K, Ts...>) {
+                return alternative_index_v<K, Ts...>;
+            } else {
+                constexpr bool same[] = {std::is_same_v<lookup_key_t<K>, key_t<unboxed_t<Ts>>>...};
+                for (std::size_t i = 0; i < sizeof...(Ts); ++i) {
+                    if (same[i]) return i;
+                }
+                return variant_npos;
+            }
+        }
+
+        /// Альтернатива, с которой сравнивается ключ K, или variant_npos
+        template<typename K, typename... Ts>
+        inline constexpr std::size_t lookup_index_v = lookup_index<K, Ts...>();
+
+        constexpr std::size_t mix(std::size_t index, std::size_t h) noexcept {
+            return h ^ (index + static_cast<std::size_t>(0x9e3779b97f4a7c15ull) + (h << 6) + (h >> 2));
+        }
+
+        constexpr std::size_t valueless_hash = mix(variant_npos, 0);
+
+        template<typename T>
+        std::size_t value_hash(T const& value) {
+            return hash<key_t<T>>()(value);
+        }
+
+        /// Хеш ключа K, равный value_hash альтернативы A с тем же значением
+        template<typename A, typename K>
+        std::size_t key_hash(K const& k) {
+            return hash<common_key_t<K, A>>()(k);
+        }
+
+        template<typename A, typename K>
+        bool key_equal(A const& a, K const& k) {
+            if constexpr (std::is_same_v<A, K>) {
+                return a == k;
+            } else {
+                return common_key_t<K, A>(a) == common_key_t<K, A>(k);
+            }
+        }
+
+    } // end hashing
+
+    namespace bucket {
+
+        template<typename F, std::size_t... Is>
+        void for_each_index(std::index_sequence<Is...>, F&& f) {
+            (f(std::integral_constant<std::size_t, Is>()), ...);
+        }
+
+        /// Позиции [0, count) вариантов first[0..count), count <= block, разложенные по index() сортировкой подсчетом:
+        /// группа g - position(begin[g]) .. position(begin[g + 1] - 1) в исходном порядке, valueless_by_exception - группа N.
+        /// Блок целиком на стеке и в L1; если все варианты блока одной альтернативы, второй проход не нужен
+        template<std::size_t N>
+        struct by_index {
+
+            constexpr static std::size_t block = 1024;
+
+            template<typename V>
+            static std::size_t group(V const& v) noexcept {
+                return v.valueless_by_exception() ? N : v.index();
+            }
+
+            template<typename It>
+            by_index(It first, std::size_t count) {
+                for (std::size_t i = 0; i < count; ++i) ++begin[group(first[i]) + 1];
+                single = count == 0 || begin[group(first[0]) + 1] == count;
+                for (std::size_t g = 1; g <= N + 1; ++g) begin[g] += begin[g - 1];
+                if (single) return;
+
+                std::array<std::uint16_t, N + 1> next{};
+                for (std::size_t g = 0; g <= N; ++g) next[g] = static_cast<std::uint16_t>(begin[g]);
+                for (std::size_t i = 0; i < count; ++i) positions[next[group(first[i])]++] = static_cast<std::uint16_t>(i);
+            }
+
+            std::size_t size(std::size_t g) const noexcept {
+                return begin[g + 1] - begin[g];
+            }
+
+            std::size_t position(std::size_t k) const noexcept {
+                return single ? k : positions[k];
+            }
+
+            std::array<std::size_t, N + 2> begin{};
+            bool single;
+            std::array<std::uint16_t, block> positions;
+        };
+
+        /// f(first + offset, n, groups) для блоков по by_index<N>::block вариантов
+        template<std::size_t N, typename It, typename F>
+        void for_each_block(It first, std::size_t count, F&& f) {
+            for (std::size_t offset = 0; offset < count; offset += by_index<N>::block) {
+                std::size_t n = std::min(by_index<N>::block, count - offset);
+                It block_first = first + static_cast<std::ptrdiff_t>(offset);
+                f(block_first, by_index<N>(block_first, n));
+            }
+        }
+
+    } // end bucket
+
+} // details end
+
+template<typename... Ts>
+struct hash<variant<Ts...>> {
+
+    using is_transparent = void;
+
+    std::size_t operator()(variant<Ts...> const& v) const {
+        if (v.valueless_by_exception()) return details::hashing::valueless_hash;
+        return details::visitor::dispatch_index<sizeof...(Ts)>(v.index(), [&](auto I) {
+            return details::hashing::mix(I, details::hashing::value_hash(details::access::variant_helper::get_value<decltype(I)::value>(v)));
+        });
+    }
+
+    /// Равен хешу variant, который хранит такое же значение
+    template<typename K, std::size_t I = details::hashing::lookup_index_v<K, Ts...>, std::enable_if_t<I != variant_npos>* = nullptr>
+    std::size_t operator()(K const& key) const {
+        using alternative_t = details::unboxed_t<details::get_type_at_t<I, Ts...>>;
+        return details::hashing::mix(I, details::hashing::key_hash<alternative_t>(key));
+    }
+};
+
+template<typename... Ts>
+struct equal_to<variant<Ts...>> {
+
+    using is_transparent = void;
+
+    bool operator()(variant<Ts...> const& v, variant<Ts...> const& w) const {
+        return v == w;
+    }
+
+    template<typename K, std::size_t I = details::hashing::lookup_index_v<K, Ts...>, std::enable_if_t<I != variant_npos>* = nullptr>
+    bool operator()(variant<Ts...> const& v, K const& key) const {
+        return v.index() == I && details::hashing::key_equal(details::access::variant_helper::get_value<I>(v), key);
+    }
+
+    template<typename K, std::size_t I = details::hashing::lookup_index_v<K, Ts...>, std::enable_if_t<I != variant_npos>* = nullptr>
+    bool operator()(K const& key, variant<Ts...> const& v) const {
+        return (*this)(v, key);
+    }
+};
+
+/// out[i] = hash<variant<Types...>>()(values[i]). Сначала позиции раскладываются по альтернативам (сортировка
+/// подсчетом), потом каждая группа хешируется своим хешером в отдельном плотном цикле без диспетчеризации
+template <class... Types>
+void hash_batch(variant<Types...> const* values, std::size_t count, std::size_t* out) {
+    constexpr std::size_t N = sizeof...(Types);
+    details::bucket::for_each_block<N>(values, count, [&](variant<Types...> const* block, auto const& groups) {
+        std::size_t* block_out = out + (block - values);
+        details::bucket::for_each_index(std::index_sequence_for<Types...>(), [&](auto I) {
+            constexpr std::size_t i = decltype(I)::value;
+            for (std::size_t k = groups.begin[i]; k < groups.begin[i + 1]; ++k) {
+                std::size_t p = groups.position(k);
+                block_out[p] = details::hashing::mix(i, details::hashing::value_hash(details::access::variant_helper::get_value<i>(block[p])));
+            }
+        });
+        for (std::size_t k = groups.begin[N]; k < groups.begin[N + 1]; ++k) {
+            block_out[groups.position(k)] = details::hashing::valueless_hash;
+        }
+    });
+}
+
+/// visit(vis, v) для каждого v из range, но сгруппированно по альтернативам: range обходится блоками по 1024
+/// варианта, позиции блока раскладываются по index() (сортировка подсчетом на стеке), затем для каждой
+/// альтернативы I vis вызывается в своем плотном цикле без диспетчеризации - вместо косвенного перехода,
+/// который на перемешанном массиве не угадывается почти на каждом элементе.
+/// Внутри блока элементы одной альтернативы обходятся в исходном порядке, разных - нет; нужен порядок -
+/// visit_each_ordered. range - диапазон с произвольным доступом; на блоке с valueless_by_exception вариантом
+/// бросается bad_variant_access до вызовов vis для этого блока.
+template <class Range, class Visitor>
+void visit_each(Range&& range, Visitor&& vis) {
+    using std::begin;
+    using std::end;
+    auto first = begin(range);
+    using V = std::decay_t<decltype(*first)>;
+    std::size_t count = static_cast<std::size_t>(end(range) - first);
+
+    details::bucket::for_each_block<V::size()>(first, count, [&](auto block, auto const& groups) {
+        if (groups.size(V::size()) != 0) details::throw_bad_variant_access();
+        details::bucket::for_each_index(std::make_index_sequence<V::size()>(), [&](auto I) {
+            constexpr std::size_t i = decltype(I)::value;
+            if (groups.single) {
+                for (std::size_t k = groups.begin[i]; k < groups.begin[i + 1]; ++k) {
+                    std::invoke(vis, details::access::variant_helper::get_value<i>(block[static_cast<std::ptrdiff_t>(k)]));
+                }
+            } else {
+                for (std::size_t k = groups.begin[i]; k < groups.begin[i + 1]; ++k) {
+                    std::invoke(vis, details::access::variant_helper::get_value<i>(block[static_cast<std::ptrdiff_t>(groups.positions[k])]));
+                }
+            }
+        });
+    });
+}
+
+/// visit_each с сохранением порядка элементов: одна диспетчеризация на серию соседних элементов с одной
+/// альтернативой. Выигрывает на сгруппированных данных, на перемешанных равен простому циклу.
+/// Подходит любой однонаправленный диапазон; на valueless_by_exception элементе бросается bad_variant_access.
+template <class Range, class Visitor>
+void visit_each_ordered(Range&& range, Visitor&& vis) {
+    using std::begin;
+    using std::end;
+    auto first = begin(range);
+    auto last = end(range);
+    using V = std::decay_t<decltype(*first)>;
+    while (first != last) {
+        if ((*first).valueless_by_exception()) details::throw_bad_variant_access();
+        details::visitor::dispatch_index<V::size()>((*first).index(), [&](auto I) {
+            constexpr std::size_t i = decltype(I)::value;
+            do {
+                std::invoke(vis, details::access::variant_helper::get_value<i>(*first));
+                ++first;
+            } while (first != last && (*first).index() == i);
+        });
+    }
+}
+
 /////////////////////////////////////////////////////// END Non-member functions //////////////////////////////////////////////////////////////////////////
 
 
@@ -1163,14 +2322,14 @@ struct variant {
 
     /* 5 */
     template <typename T, typename... As,
-            std::size_t I = details::get_id_at_v<T, Ts...>,
+            std::size_t I = details::alternative_index_v<T, Ts...>,
             std::enable_if_t<std::is_constructible_v<T, As...>>* = nullptr>
     constexpr explicit variant(std::in_place_type_t<T>, As&&... args) noexcept(std::is_nothrow_constructible_v<T, As...>)
         : storage(std::in_place_index<I>, std::forward<As>(args)...) {}
 
     /* 6 */
     template <typename T, typename U, typename... As,
-            std::size_t I = details::get_id_at_v<T, Ts...>,
+            std::size_t I = details::alternative_index_v<T, Ts...>,
             std::enable_if_t<std::is_constructible_v<T, std::initializer_list<U>, As...>>* = nullptr>
     constexpr explicit variant(std::in_place_type_t<T>, std::initializer_list<U> il, As&&... args) noexcept(std::is_nothrow_constructible_v<T, std::initializer_list<U>, As...>)
         : storage(std::in_place_index<I>, il, std::forward<As>(args)...) {}
@@ -1216,29 +2375,45 @@ struct variant {
 
 
     template <class T, class... Args,
-              std::size_t I = details::get_id_at_v<T, Ts...>,
+              std::size_t I = details::alternative_index_v<T, Ts...>,
               std::enable_if_t<std::is_constructible_v<T, Args...>>* = nullptr>
     T& emplace(Args&&... args) {
-        return storage.template emplace<I>(std::forward<Args>(args)...);
+        return details::unbox(storage.template emplace<I>(std::forward<Args>(args)...));
     }
 
     template <class T, class U, class... Args,
-              std::size_t I = details::get_id_at_v<T, Ts...>,
+              std::size_t I = details::alternative_index_v<T, Ts...>,
               std::enable_if_t<std::is_constructible_v<T, std::initializer_list<U>&, Args...>>* = nullptr>
     T& emplace(std::initializer_list<U> il, Args&&... args) {
-        storage.template emplace<I>(il, std::forward<Args>(args)...);
+        return details::unbox(storage.template emplace<I>(il, std::forward<Args>(args)...));
     }
 
     template <size_t I, class... Args,
               std::enable_if_t<std::is_constructible_v<details::get_type_at_t<I, Ts...>, Args...>>* = nullptr>
-    variant_alternative_t<I, variant>& emplace(Args&&... args) {
-        storage.template emplace<I>(std::forward<Args>(args)...);
+    details::unboxed_t<variant_alternative_t<I, variant>>& emplace(Args&&... args) {
+        return details::unbox(storage.template emplace<I>(std::forward<Args>(args)...));
     }
 
     template <size_t I, class U, class... Args,
               std::enable_if_t<std::is_constructible_v<details::get_type_at_t<I, Ts...>, std::initializer_list<U>&, Args...>>* = nullptr>
-    variant_alternative_t<I, variant>& emplace(std::initializer_list<U> il, Args&&... args) {
-        storage.template emplace<I>(il, std::forward<Args>(args)...);
+    details::unboxed_t<variant_alternative_t<I, variant>>& emplace(std::initializer_list<U> il, Args&&... args) {
+        return details::unbox(storage.template emplace<I>(il, std::forward<Args>(args)...));
+    }
+
+    /// Альтернатива I из результата factory(): prvalue строится прямо в хранилище (подходит и для
+    /// неперемещаемых типов). Если factory может бросить, а тип переносится без исключений, старое значение
+    /// остается при исключении нетронутым; иначе variant становится valueless_by_exception
+    template <size_t I, class F,
+              std::enable_if_t<details::constructible_from_result_v<details::get_type_at_t<I, Ts...>, F>>* = nullptr>
+    details::unboxed_t<variant_alternative_t<I, variant>>& emplace_with(F&& factory) {
+        return details::unbox(storage.template emplace_with<I>(std::forward<F>(factory)));
+    }
+
+    template <class T, class F,
+              std::size_t I = details::alternative_index_v<T, Ts...>,
+              std::enable_if_t<details::constructible_from_result_v<details::get_type_at_t<I, Ts...>, F>>* = nullptr>
+    T& emplace_with(F&& factory) {
+        return emplace_with<I>(std::forward<F>(factory));
     }
 
     constexpr std::size_t index() const noexcept {
@@ -1253,14 +2428,20 @@ struct variant {
         return sizeof...(Ts);
     }
 
-    void swap(variant& rhs ) noexcept(((std::is_nothrow_move_constructible_v<Ts> &&
+    void swap(variant& rhs ) noexcept((is_trivially_relocatable_v<Ts> && ...) ||
+                                      ((std::is_nothrow_move_constructible_v<Ts> &&
                                          std::is_nothrow_swappable_v<Ts>) && ...)) {
         storage.swap(rhs.storage);
     }
 
     friend struct details::access::variant_helper;
     friend struct details::visitor::variant_helper;
-private:
+protected:
+
+    /// Для наследников, которые сами конструируют альтернативу (allocator_variant): variant без значения
+    struct valueless_tag {};
+
+    explicit variant(valueless_tag) : storage() {}
 
     details::storage::storage_t<Ts...> storage;
 
@@ -1268,5 +2449,12 @@ private:
 
 } // end vr
 
+namespace std {
+
+/// vr::variant - ключ unordered контейнеров и с std::hash по умолчанию
+template<typename... Ts>
+struct hash<vr::variant<Ts...>> : vr::hash<vr::variant<Ts...>> {};
+
+} // end std
 
 #endif // VARIANT_H
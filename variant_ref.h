@@ -0,0 +1,220 @@
+#ifndef VARIANT_REF_H
+#define VARIANT_REF_H
+
+#include "variant.h"
+#include <memory>
+
+namespace vr {
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// variant_ref<Ts...> - невладеющая ссылка на "один из" объектов Ts...: указатель на объект плюс индекс
+/// альтернативы (два слова, без копий). Строится из любого T& (T из Ts...) или из variant<Ts...>& - тогда
+/// ссылается на его активную альтернативу (для boxed<T> - на сам T). Связь нельзя перенаправить на временный объект.
+///
+/// const_variant_ref<Ts...> == variant_ref<Ts const...>: строится и из const объектов, и из variant_ref<Ts...>.
+///
+///     void print(vr::const_variant_ref<int, std::string> arg) { vr::visit(printer(), arg); }
+///     print(i); print(s); print(v); // v - vr::variant<int, std::string>, ничего не копируется
+///
+/// visit передает visitor'у T& (T const& для const альтернатив) и диспетчеризует так же, как visit вариантов
+/// (dispatch_index по индексу, для нескольких ссылок - по линейному индексу flat_index).
+/// Как и обычная ссылка, variant_ref не продлевает жизнь объекта и не бывает valueless.
+///
+
+template<typename... Ts>
+struct variant_ref;
+
+template<typename... Ts>
+using const_variant_ref = variant_ref<Ts const...>;
+
+template<typename... Ts>
+struct variant_size<variant_ref<Ts...>> : std::integral_constant<std::size_t, sizeof...(Ts)> {};
+
+template<std::size_t I, typename... Ts>
+struct variant_alternative<I, variant_ref<Ts...>> {
+    using type = details::get_type_at_t<I, Ts...>;
+};
+
+namespace details {
+
+    namespace ref {
+
+        /// T& привязывается к альтернативе T или T const
+        template<typename T, typename... Ts>
+        inline constexpr bool binds_v = (std::is_same_v<T, Ts> || ...) || (std::is_same_v<T const, Ts> || ...);
+
+        template<typename T, typename... Ts>
+        inline constexpr std::size_t index_v = (std::is_same_v<T, Ts> || ...) ? get_id_at_v<T, Ts...> : get_id_at_v<T const, Ts...>;
+
+        template<typename T>
+        struct is_variant_ref : std::false_type {};
+
+        template<typename... Ts>
+        struct is_variant_ref<variant_ref<Ts...>> : std::true_type {};
+
+        template<typename T>
+        inline constexpr bool is_variant_ref_v = is_variant_ref<std::decay_t<T>>::value;
+
+        /// Ячейка плоской таблицы с линейным индексом L
+        template<typename Index, std::size_t L, typename Visitor, typename... Refs, std::size_t... Ks>
+        decltype(auto) visit_cell(std::index_sequence<Ks...>, Visitor&& visitor, Refs const&... refs) {
+            return std::invoke(std::forward<Visitor>(visitor), *refs.template pointer<Index::coordinate(L, Ks)>()...);
+        }
+
+        template<visit_strategy S, typename Visitor, typename... Refs>
+        decltype(auto) visit(Visitor&& visitor, Refs const&... refs) {
+            using index_t = visitor::flat_index<Refs::size()...>;
+            return visitor::dispatch_index<index_t::size, S>(index_t::linear(refs.index()...), [&](auto L) -> decltype(auto) {
+                return visit_cell<index_t, decltype(L)::value>(std::index_sequence_for<Refs...>(), std::forward<Visitor>(visitor), refs...);
+            });
+        }
+
+    } // end ref
+
+} // details end
+
+template<typename... Ts>
+struct variant_ref {
+
+    static_assert(0 < sizeof...(Ts), "variant_ref must have at least one alternative");
+    static_assert(((std::is_object_v<Ts> && !std::is_array_v<Ts>) && ...), "variant_ref alternatives must be non-array object types");
+
+    template<typename T,
+             std::enable_if_t<details::ref::binds_v<T, Ts...>>* = nullptr,
+             std::size_t I = details::ref::index_v<T, Ts...>>
+    variant_ref(T& value) noexcept : ptr(erase(std::addressof(value))), indx(I) {}
+
+    template<std::size_t I, typename T = details::get_type_at_t<I, Ts...>>
+    explicit variant_ref(std::in_place_index_t<I>, T& value) noexcept : ptr(erase(std::addressof(value))), indx(I) {}
+
+    /// Ссылка на активную альтернативу; у valueless_by_exception варианта ее нет - bad_variant_access
+    template<typename... Us,
+             std::enable_if_t<sizeof...(Us) == sizeof...(Ts) &&
+                              (std::is_same_v<details::unboxed_t<Us>, std::remove_const_t<Ts>> && ...)>* = nullptr>
+    variant_ref(variant<Us...>& v) : ptr(address(v)), indx(static_cast<index_type>(v.index())) {}
+
+    template<typename... Us,
+             std::enable_if_t<sizeof...(Us) == sizeof...(Ts) && (std::is_const_v<Ts> && ...) &&
+                              (std::is_same_v<details::unboxed_t<Us>, std::remove_const_t<Ts>> && ...)>* = nullptr>
+    variant_ref(variant<Us...> const& v) : ptr(address(v)), indx(static_cast<index_type>(v.index())) {}
+
+    /// Ссылка на временный вариант повисла бы в конце выражения
+    template<typename... Us,
+             std::enable_if_t<sizeof...(Us) == sizeof...(Ts) &&
+                              (std::is_same_v<details::unboxed_t<Us>, std::remove_const_t<Ts>> && ...)>* = nullptr>
+    variant_ref(variant<Us...> const&&) = delete;
+
+    /// variant_ref<Ts...> -> variant_ref<Ts const...>
+    template<typename... Us,
+             std::enable_if_t<sizeof...(Us) == sizeof...(Ts) && !std::is_same_v<variant_ref<Us...>, variant_ref> &&
+                              (std::is_same_v<Us const, Ts> && ...)>* = nullptr>
+    variant_ref(variant_ref<Us...> const& other) noexcept : ptr(other.ptr), indx(other.indx) {}
+
+    variant_ref(variant_ref const&) = default;
+    variant_ref& operator =(variant_ref const&) = default;
+
+    constexpr std::size_t index() const noexcept {
+        return indx;
+    }
+
+    constexpr bool valueless_by_exception() const noexcept {
+        return false;
+    }
+
+    constexpr static std::size_t size() {
+        return sizeof...(Ts);
+    }
+
+    void swap(variant_ref& rhs) noexcept {
+        std::swap(ptr, rhs.ptr);
+        std::swap(indx, rhs.indx);
+    }
+
+    /// Указатель на объект альтернативы I, без проверки индекса
+    template<std::size_t I>
+    details::get_type_at_t<I, Ts...>* pointer() const noexcept {
+        return static_cast<details::get_type_at_t<I, Ts...>*>(ptr);
+    }
+
+    template<visit_strategy S = visit_strategy::inline_switch, typename Visitor>
+    decltype(auto) visit(Visitor&& visitor) const {
+        return details::ref::visit<S>(std::forward<Visitor>(visitor), *this);
+    }
+
+private:
+
+    template<typename...>
+    friend struct variant_ref;
+
+    using index_type = details::variant_index_t<sizeof...(Ts)>;
+
+    template<typename T>
+    static void* erase(T* p) noexcept {
+        return const_cast<void*>(static_cast<void const*>(p));
+    }
+
+    template<typename V>
+    static void* address(V& v) {
+        if (v.valueless_by_exception()) details::throw_bad_variant_access();
+        return details::visitor::dispatch_index<sizeof...(Ts)>(v.index(), [&](auto I) {
+            return erase(std::addressof(details::access::variant_helper::get_value<decltype(I)::value>(v)));
+        });
+    }
+
+    void* ptr;
+    index_type indx;
+};
+
+/////////////////////////////////////////////////////// Non-member functions //////////////////////////////////////////////////////////////////////////
+
+/// По значению: так перегрузка точнее общего visit(Visitor&&, Variants&&...) для любой категории значения
+template <class Visitor, class... Ts, class... Refs, std::enable_if_t<(details::ref::is_variant_ref_v<Refs> && ...)>* = nullptr>
+decltype(auto) visit(Visitor&& vis, variant_ref<Ts...> ref, Refs... refs) {
+    return details::ref::visit<visit_strategy::inline_switch>(std::forward<Visitor>(vis), ref, refs...);
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+template <typename T, typename... Ts>
+constexpr bool holds_alternative(variant_ref<Ts...> const& v) noexcept {
+    return details::ref::index_v<T, Ts...> == v.index();
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+template <std::size_t I, class... Types>
+variant_alternative_t<I, variant_ref<Types...>>& get(variant_ref<Types...> const& v) {
+    if (v.index() != I) details::throw_bad_variant_access();
+    return *v.template pointer<I>();
+}
+
+template <class T, class... Types, std::size_t I = details::ref::index_v<T, Types...>>
+variant_alternative_t<I, variant_ref<Types...>>& get(variant_ref<Types...> const& v) {
+    return get<I>(v);
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+template <std::size_t I, class... Types>
+variant_alternative_t<I, variant_ref<Types...>>* get_if(variant_ref<Types...> const* pv) noexcept {
+    return pv && pv->index() == I ? pv->template pointer<I>() : nullptr;
+}
+
+template <class T, class... Types>
+auto get_if(variant_ref<Types...> const* pv) noexcept {
+    return get_if<details::ref::index_v<T, Types...>>(pv);
+}
+
+//////////////////////////////////////////////////////////////
+
+template <class... Types>
+void swap(variant_ref<Types...>& lhs, variant_ref<Types...>& rhs) noexcept {
+    lhs.swap(rhs);
+}
+
+/////////////////////////////////////////////////////// END Non-member functions //////////////////////////////////////////////////////////////////////////
+
+} // end vr
+
+#endif // VARIANT_REF_H
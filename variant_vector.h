@@ -0,0 +1,351 @@
+#ifndef VARIANT_VECTOR_H
+#define VARIANT_VECTOR_H
+
+#include "variant.h"
+#include "variant_ref.h"
+#include <cstdint>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+
+#if defined(__has_include)
+#   if __has_include(<span>)
+#       include <span>
+#   endif
+#endif
+
+namespace vr {
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///
+/// variant_vector<Ts...> - последовательность значений "один из Ts..." в виде структуры массивов:
+/// упакованный массив тегов (variant_index_t<N>, обычно байт на элемент), номер элемента в его столбце
+/// (uint32_t) и по плотному std::vector<T> на каждую альтернативу. В отличие от std::vector<variant<Ts...>>,
+/// элемент не занимает размер наибольшей альтернативы: память - sizeof(T) + 5 байт для каждого T, который
+/// в нем реально лежит. Проход по всем int читает только столбец int.
+///
+///     vr::variant_vector<int, double, std::string> values;
+///     values.push_back(1); values.push_back(std::string("s")); values.emplace<double>(2.5);
+///     vr::visit(printer(), values[1]);            // variant_ref<int, double, std::string> на строку
+///     for (double d : values.values<double>()) {} // span<double>: только double, в порядке элементов
+///
+/// values[i] - variant_ref (const_variant_ref для const контейнера) на элемент i. Как и ссылки на элементы
+/// std::vector, он становится недействительным после вставки альтернативы того же типа или erase.
+/// Столбцы хранят альтернативы в порядке элементов; erase сохраняет порядок и стоит O(size()), как у std::vector.
+///
+/// values<T>() возвращает std::span, если он есть в стандартной библиотеке, иначе vr::span - указатель и длину
+/// с тем же базовым интерфейсом (data, size, empty, begin/end, operator[]).
+///
+
+#if defined(__cpp_lib_span)
+
+template<typename T>
+using span = std::span<T>;
+
+#else
+
+template<typename T>
+class span {
+public:
+    using element_type = T;
+    using value_type = std::remove_cv_t<T>;
+    using iterator = T*;
+
+    constexpr span() noexcept : ptr(nullptr), count(0) {}
+    constexpr span(T* data, std::size_t size) noexcept : ptr(data), count(size) {}
+
+    template<typename U, std::enable_if_t<std::is_convertible_v<U(*)[], T(*)[]>>* = nullptr>
+    constexpr span(span<U> other) noexcept : ptr(other.data()), count(other.size()) {}
+
+    constexpr T* data() const noexcept { return ptr; }
+    constexpr std::size_t size() const noexcept { return count; }
+    constexpr bool empty() const noexcept { return count == 0; }
+    constexpr T* begin() const noexcept { return ptr; }
+    constexpr T* end() const noexcept { return ptr + count; }
+    constexpr T& operator [](std::size_t i) const noexcept { return ptr[i]; }
+
+private:
+    T* ptr;
+    std::size_t count;
+};
+
+#endif
+
+template<typename... Ts>
+class variant_vector {
+
+    static_assert(0 < sizeof...(Ts), "variant_vector must have at least one alternative");
+    static_assert(((std::is_object_v<Ts> && !std::is_array_v<Ts> && !std::is_const_v<Ts>) && ...),
+                  "variant_vector alternatives must be non-const non-array object types");
+
+public:
+
+    using value_type = variant<Ts...>;
+    using reference = variant_ref<Ts...>;
+    using const_reference = const_variant_ref<Ts...>;
+    using tag_type = details::variant_index_t<sizeof...(Ts)>;
+    using size_type = std::size_t;
+
+    constexpr static std::size_t size_alternatives() {
+        return sizeof...(Ts);
+    }
+
+//////////////////////////// Capacity ///////////////////////////////////
+
+    size_type size() const noexcept {
+        return tags_.size();
+    }
+
+    bool empty() const noexcept {
+        return tags_.empty();
+    }
+
+    /// Резервирует место под n тегов; столбцы растут по мере появления своих альтернатив
+    void reserve(size_type n) {
+        tags_.reserve(n);
+        slots.reserve(n);
+    }
+
+    /// Резервирует место под n альтернатив I
+    template<std::size_t I>
+    void reserve_alternative(size_type n) {
+        std::get<I>(columns).reserve(n);
+    }
+
+//////////////////////////// Modifiers ///////////////////////////////////
+
+    template<std::size_t I, typename... As>
+    details::get_type_at_t<I, Ts...>& emplace(As&&... args) {
+        auto& column = std::get<I>(columns);
+        if (column.size() == std::numeric_limits<std::uint32_t>::max()) {
+            details::throw_error<std::length_error>("variant_vector: too many values of one alternative");
+        }
+        column.emplace_back(std::forward<As>(args)...);
+        VR_TRY {
+            tags_.push_back(static_cast<tag_type>(I));
+            slots.push_back(static_cast<std::uint32_t>(column.size() - 1));
+        } VR_CATCH_ALL {
+            if (tags_.size() > slots.size()) tags_.pop_back();
+            column.pop_back();
+            VR_RETHROW;
+        }
+        return column.back();
+    }
+
+    template<typename T, typename... As, std::size_t I = details::alternative_index_v<T, Ts...>>
+    T& emplace(As&&... args) {
+        return emplace<I>(std::forward<As>(args)...);
+    }
+
+    template<typename T, std::enable_if_t<details::has_alternative_v<std::decay_t<T>, Ts...>>* = nullptr>
+    void push_back(T&& value) {
+        emplace<details::alternative_index_v<std::decay_t<T>, Ts...>>(std::forward<T>(value));
+    }
+
+    /// Активная альтернатива варианта; у valueless_by_exception ее нет - bad_variant_access
+    void push_back(value_type const& v) {
+        push_variant(v);
+    }
+
+    void push_back(value_type&& v) {
+        push_variant(std::move(v));
+    }
+
+    void pop_back() {
+        erase(size() - 1);
+    }
+
+    /// Удаляет элемент pos, сохраняя порядок остальных
+    void erase(size_type pos) {
+        std::size_t tag = tags_[pos];
+        std::uint32_t slot = slots[pos];
+        details::visitor::dispatch_index<sizeof...(Ts)>(tag, [&](auto I) {
+            auto& column = std::get<decltype(I)::value>(columns);
+            column.erase(column.begin() + slot);
+        });
+        for (size_type i = pos + 1; i < tags_.size(); ++i) {
+            if (tags_[i] == tag) --slots[i];
+        }
+        tags_.erase(tags_.begin() + static_cast<std::ptrdiff_t>(pos));
+        slots.erase(slots.begin() + static_cast<std::ptrdiff_t>(pos));
+    }
+
+    void clear() noexcept {
+        tags_.clear();
+        slots.clear();
+        std::apply([](auto&... column) { (column.clear(), ...); }, columns);
+    }
+
+    void swap(variant_vector& rhs) noexcept {
+        tags_.swap(rhs.tags_);
+        slots.swap(rhs.slots);
+        columns.swap(rhs.columns);
+    }
+
+//////////////////////////// Element access ///////////////////////////////////
+
+    reference operator [](size_type pos) noexcept {
+        return make_ref<reference>(*this, pos);
+    }
+
+    const_reference operator [](size_type pos) const noexcept {
+        return make_ref<const_reference>(*this, pos);
+    }
+
+    reference at(size_type pos) {
+        check(pos);
+        return (*this)[pos];
+    }
+
+    const_reference at(size_type pos) const {
+        check(pos);
+        return (*this)[pos];
+    }
+
+    /// Индекс альтернативы элемента pos
+    std::size_t index(size_type pos) const noexcept {
+        return tags_[pos];
+    }
+
+    /// Копия элемента pos как variant<Ts...>
+    value_type get_variant(size_type pos) const {
+        return details::visitor::dispatch_index<sizeof...(Ts)>(tags_[pos], [&](auto I) {
+            return value_type(std::in_place_index<decltype(I)::value>, std::get<decltype(I)::value>(columns)[slots[pos]]);
+        });
+    }
+
+    /// Упакованный массив тегов: tags()[i] == index(i)
+    span<tag_type const> tags() const noexcept {
+        return {tags_.data(), tags_.size()};
+    }
+
+    /// Все альтернативы I в порядке элементов
+    template<std::size_t I>
+    span<details::get_type_at_t<I, Ts...>> values() noexcept {
+        auto& column = std::get<I>(columns);
+        return {column.data(), column.size()};
+    }
+
+    template<std::size_t I>
+    span<details::get_type_at_t<I, Ts...> const> values() const noexcept {
+        auto const& column = std::get<I>(columns);
+        return {column.data(), column.size()};
+    }
+
+    template<typename T, std::size_t I = details::alternative_index_v<T, Ts...>>
+    span<T> values() noexcept {
+        return values<I>();
+    }
+
+    template<typename T, std::size_t I = details::alternative_index_v<T, Ts...>>
+    span<T const> values() const noexcept {
+        return values<I>();
+    }
+
+    template<typename T>
+    size_type count() const noexcept {
+        return std::get<details::alternative_index_v<T, Ts...>>(columns).size();
+    }
+
+    /// vis для каждого значения, столбец за столбцом: группировать по альтернативам уже не нужно
+    template<typename Visitor>
+    void visit_each(Visitor&& vis) {
+        std::apply([&](auto&... column) { (visit_column(column, vis), ...); }, columns);
+    }
+
+    template<typename Visitor>
+    void visit_each(Visitor&& vis) const {
+        std::apply([&](auto const&... column) { (visit_column(column, vis), ...); }, columns);
+    }
+
+    /// vis для каждого значения в порядке элементов, одна диспетчеризация на серию одинаковых тегов
+    template<typename Visitor>
+    void visit_each_ordered(Visitor&& vis) {
+        visit_runs(*this, vis);
+    }
+
+    template<typename Visitor>
+    void visit_each_ordered(Visitor&& vis) const {
+        visit_runs(*this, vis);
+    }
+
+private:
+
+    template<typename Ref, typename Self>
+    static Ref make_ref(Self& self, size_type pos) noexcept {
+        return details::visitor::dispatch_index<sizeof...(Ts)>(self.tags_[pos], [&](auto I) {
+            return Ref(std::in_place_index<decltype(I)::value>, std::get<decltype(I)::value>(self.columns)[self.slots[pos]]);
+        });
+    }
+
+    template<typename Column, typename Visitor>
+    static void visit_column(Column& column, Visitor& vis) {
+        for (auto& value : column) std::invoke(vis, value);
+    }
+
+    template<typename Self, typename Visitor>
+    static void visit_runs(Self& self, Visitor& vis) {
+        std::array<std::size_t, sizeof...(Ts)> next{};
+        size_type pos = 0;
+        while (pos < self.size()) {
+            details::visitor::dispatch_index<sizeof...(Ts)>(self.tags_[pos], [&](auto I) {
+                constexpr std::size_t i = decltype(I)::value;
+                auto& column = std::get<i>(self.columns);
+                do {
+                    std::invoke(vis, column[next[i]++]);
+                } while (++pos < self.size() && self.tags_[pos] == i);
+            });
+        }
+    }
+
+    template<typename V>
+    void push_variant(V&& v) {
+        if (v.valueless_by_exception()) details::throw_bad_variant_access();
+        details::visitor::dispatch_index<sizeof...(Ts)>(v.index(), [&](auto I) {
+            emplace<decltype(I)::value>(details::access::variant_helper::get_value<decltype(I)::value>(std::forward<V>(v)));
+        });
+    }
+
+    void check(size_type pos) const {
+        if (pos >= size()) details::throw_error<std::out_of_range>("variant_vector: index out of range");
+    }
+
+    std::vector<tag_type> tags_;
+    std::vector<std::uint32_t> slots;
+    std::tuple<std::vector<Ts>...> columns;
+};
+
+/////////////////////////////////////////////////////// Non-member functions //////////////////////////////////////////////////////////////////////////
+
+template <class... Types, class Visitor>
+void visit_each(variant_vector<Types...>& values, Visitor&& vis) {
+    values.visit_each(std::forward<Visitor>(vis));
+}
+
+template <class... Types, class Visitor>
+void visit_each(variant_vector<Types...> const& values, Visitor&& vis) {
+    values.visit_each(std::forward<Visitor>(vis));
+}
+
+template <class... Types, class Visitor>
+void visit_each_ordered(variant_vector<Types...>& values, Visitor&& vis) {
+    values.visit_each_ordered(std::forward<Visitor>(vis));
+}
+
+template <class... Types, class Visitor>
+void visit_each_ordered(variant_vector<Types...> const& values, Visitor&& vis) {
+    values.visit_each_ordered(std::forward<Visitor>(vis));
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+template <class... Types>
+void swap(variant_vector<Types...>& lhs, variant_vector<Types...>& rhs) noexcept {
+    lhs.swap(rhs);
+}
+
+/////////////////////////////////////////////////////// END Non-member functions //////////////////////////////////////////////////////////////////////////
+
+} // end vr
+
+#endif // VARIANT_VECTOR_H